@@ -42,6 +42,7 @@ typedef struct {
 	int bit_high_dir; /*! xCBUS 0-7 default direction (0: in, 1: out) */
 	int index;
 	int status_pin;
+	int buffer_size;  /*! MPSSE host side command buffer size (0: default) */
 } mpsse_bit_config;
 
 /*!
@@ -68,10 +69,10 @@ struct cable_t {
 
 /* FTDI serial (MPSSE) configuration */
 #define FTDI_SER(_vid, _pid, _intf, _blv, _bld, _bhv, _bhd) \
-	{MODE_FTDI_SERIAL, _vid, _pid, 0, 0, {_intf, _blv, _bld, _bhv, _bhd, 0, -1}}
+	{MODE_FTDI_SERIAL, _vid, _pid, 0, 0, {_intf, _blv, _bld, _bhv, _bhd, 0, -1, 0}}
 /* FTDI bitbang configuration */
 #define FTDI_BB(_vid, _pid, _intf, _blv, _bld, _bhv, _bhd) \
-	{MODE_FTDI_BITBANG, _vid, _pid, 0, 0, {_intf, _blv, _bld, _bhv, _bhd, 0, -1}}
+	{MODE_FTDI_BITBANG, _vid, _pid, 0, 0, {_intf, _blv, _bld, _bhv, _bhd, 0, -1, 0}}
 /* CMSIS DAP configuration */
 #define CMSIS_CL(_vid, _pid) \
 	{MODE_CMSISDAP, _vid, _pid, 0, 0, {}}
@@ -79,7 +80,7 @@ struct cable_t {
 #define CABLE_DEF(_type, _vid, _pid) \
 	{_type, _vid, _pid, 0, 0, {}}
 #define CABLE_DEF_FULL(_type, _vid, _pid, _blv, _bld, _bhv, _bhd) \
-	{_type, _vid, _pid, 0, 0, {0, _blv, _bld, _bhv, _bhd, 0, -1}}
+	{_type, _vid, _pid, 0, 0, {0, _blv, _bld, _bhv, _bhd, 0, -1, 0}}
 
 static std::map <std::string, cable_t> cable_list = {
 	// last 4 bytes are ADBUS7-0 value, ADBUS7-0 direction, ACBUS7-0 value, ACBUS7-0 direction
@@ -6,8 +6,13 @@
 
 #include "common.hpp"
 
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <errno.h>
+
 #include <string>
 #include <cstdlib>
+#include <cstring>
 
 /*!
  * \brief return shell environment variable value
@@ -19,3 +24,57 @@ const std::string get_shell_env_var(const char* key,
 	const char* ret = std::getenv(key);
 	return std::string(ret ? ret : def_val);
 }
+
+/* create directory (and its parent) if not exists */
+static bool make_dir(const std::string &path)
+{
+	if (mkdir(path.c_str(), 0755) == 0 || errno == EEXIST)
+		return true;
+	if (errno != ENOENT)
+		return false;
+	size_t pos = path.find_last_of('/');
+	if (pos == std::string::npos || pos == 0)
+		return false;
+	if (!make_dir(path.substr(0, pos)))
+		return false;
+	return (mkdir(path.c_str(), 0755) == 0 || errno == EEXIST);
+}
+
+const std::string get_cache_dir() noexcept {
+	std::string dir = get_shell_env_var("OPENFPGALOADER_CACHE_DIR");
+	if (dir.empty()) {
+		std::string base = get_shell_env_var("XDG_CACHE_HOME");
+		if (base.empty()) {
+			base = get_shell_env_var("HOME");
+			if (base.empty())
+				return "";
+			base += "/.cache";
+		}
+		dir = base + "/openFPGALoader";
+	}
+
+	if (!make_dir(dir))
+		return "";
+	return dir;
+}
+
+void reverse_bytes(const uint8_t *src, uint8_t *dst, size_t len) noexcept
+{
+	size_t i = 0;
+
+	/* swap bits, pairs and nibbles of 8 bytes in one pass */
+	for (; i + 8 <= len; i += 8) {
+		uint64_t v;
+		memcpy(&v, src + i, 8);
+		v = ((v >> 1) & 0x5555555555555555ULL) | ((v & 0x5555555555555555ULL) << 1);
+		v = ((v >> 2) & 0x3333333333333333ULL) | ((v & 0x3333333333333333ULL) << 2);
+		v = ((v >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((v & 0x0F0F0F0F0F0F0F0FULL) << 4);
+		memcpy(dst + i, &v, 8);
+	}
+	for (; i < len; i++) {
+		uint8_t b = src[i];
+		b = ((b >> 1) & 0x55) | ((b & 0x55) << 1);
+		b = ((b >> 2) & 0x33) | ((b & 0x33) << 2);
+		dst[i] = (b >> 4) | (b << 4);
+	}
+}
@@ -6,6 +6,8 @@
 #ifndef SRC_COMMON_HPP_
 #define SRC_COMMON_HPP_
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 
 /*!
@@ -17,4 +19,20 @@
 const std::string get_shell_env_var(const char* key,
 	const char *def_val="") noexcept;
 
+/*!
+ * \brief return (and create if required) directory used to store
+ *        cached informations: OPENFPGALOADER_CACHE_DIR,
+ *        $XDG_CACHE_HOME/openFPGALoader or $HOME/.cache/openFPGALoader
+ * \return directory path (without trailing /) or "" when not available
+ */
+const std::string get_cache_dir() noexcept;
+
+/*!
+ * \brief reverse bit order of each byte (64 bits at a time)
+ * \param[in] src: source bytes
+ * \param[out] dst: destination (may be src)
+ * \param[in] len: number of bytes
+ */
+void reverse_bytes(const uint8_t *src, uint8_t *dst, size_t len) noexcept;
+
 #endif  // SRC_COMMON_HPP_
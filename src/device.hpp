@@ -49,9 +49,60 @@ class Device {
 		virtual bool dumpFlash(uint32_t base_addr, uint32_t len) {
 			(void) base_addr; (void) len;
 			printError("dump flash not supported"); return false;}
+		/*!
+		 * \brief check flash content against a manifest (hashes)
+		 */
+		virtual bool verifyFlashManifest() {
+			printError("flash manifest not supported"); return false;}
 		virtual bool protect_flash(uint32_t len) = 0;
 		virtual bool unprotect_flash() = 0;
 		virtual bool bulk_erase_flash() = 0;
+		/*!
+		 * \brief start a flash session: flash operations done until
+		 *        end_flash_session share one flash access (device
+		 *        switched to flash access and reloaded once)
+		 */
+		virtual void begin_flash_session() {}
+		/*!
+		 * \brief end a flash session
+		 * \return false when device reload fails
+		 */
+		virtual bool end_flash_session() {return true;}
+
+		/*!
+		 * \class FlashSession
+		 * \brief flash session bound to object lifetime
+		 */
+		class FlashSession {
+			public:
+				explicit FlashSession(Device *dev): _dev(dev) {
+					_dev->begin_flash_session();
+				}
+				/*!
+				 * \brief close session if still open: result can't
+				 *        be returned, a failure is only displayed (use
+				 *        close to get it)
+				 */
+				~FlashSession() {
+					if (!close())
+						printError("Error: device reload failed");
+				}
+				/*!
+				 * \brief end session before object destruction
+				 * \return false when device reload fails
+				 */
+				bool close() {
+					if (!_dev)
+						return true;
+					Device *dev = _dev;
+					_dev = NULL;
+					return dev->end_flash_session();
+				}
+			private:
+				FlashSession(const FlashSession &);
+				FlashSession &operator=(const FlashSession &);
+				Device *_dev;
+		};
 
 		virtual uint32_t idCode() = 0;
 		virtual void reset();
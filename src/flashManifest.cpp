@@ -0,0 +1,291 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "display.hpp"
+#include "flashManifest.hpp"
+
+/* CRC32C reflected polynomial */
+#define CRC32C_POLY 0x82F63B78
+
+static const uint32_t sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+	0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+	0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+	0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+	0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+	0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t ror(uint32_t x, int n)
+{
+	return (x >> n) | (x << (32 - n));
+}
+
+/* process one 64 Byte block */
+static void sha256_block(uint32_t *state, const uint8_t *blk)
+{
+	uint32_t w[64];
+	for (int i = 0; i < 16; i++)
+		w[i] = ((uint32_t)blk[4 * i] << 24) | ((uint32_t)blk[4 * i + 1] << 16) |
+			((uint32_t)blk[4 * i + 2] << 8) | blk[4 * i + 3];
+	for (int i = 16; i < 64; i++) {
+		uint32_t s0 = ror(w[i - 15], 7) ^ ror(w[i - 15], 18) ^ (w[i - 15] >> 3);
+		uint32_t s1 = ror(w[i - 2], 17) ^ ror(w[i - 2], 19) ^ (w[i - 2] >> 10);
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+
+	uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+	uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+	for (int i = 0; i < 64; i++) {
+		uint32_t t1 = h + (ror(e, 6) ^ ror(e, 11) ^ ror(e, 25)) +
+			((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+		uint32_t t2 = (ror(a, 2) ^ ror(a, 13) ^ ror(a, 22)) +
+			((a & b) ^ (a & c) ^ (b & c));
+		h = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+	state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+	state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+FlashManifest::FlashManifest(uint32_t base_addr, uint32_t len,
+		uint32_t block_size): _base_addr(base_addr), _len(len),
+		_block_size(block_size), _sha_len(0), _blk_crc(0), _blk_fill(0)
+{
+	static const uint32_t sha256_init[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+		0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+	};
+	memcpy(_sha_state, sha256_init, sizeof(_sha_state));
+	memset(_sha_buf, 0, sizeof(_sha_buf));
+	if (_block_size == 0)
+		_block_size = FLASH_MANIFEST_BLOCK;
+}
+
+namespace {
+struct crc32c_table_t {
+	uint32_t v[256];
+	crc32c_table_t() {
+		for (uint32_t i = 0; i < 256; i++) {
+			uint32_t c = i;
+			for (int j = 0; j < 8; j++)
+				c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+			v[i] = c;
+		}
+	}
+};
+}  // namespace
+
+uint32_t FlashManifest::crc32c(uint32_t crc, const uint8_t *data, size_t len)
+{
+	/* built once (thread safe) */
+	static const crc32c_table_t table;
+
+	crc = ~crc;
+	for (size_t i = 0; i < len; i++)
+		crc = table.v[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+void FlashManifest::update(const uint8_t *data, uint32_t len)
+{
+	/* per block CRC32C */
+	const uint8_t *ptr = data;
+	uint32_t remain = len;
+	while (remain > 0) {
+		uint32_t size = std::min(remain, _block_size - _blk_fill);
+		_blk_crc = crc32c(_blk_crc, ptr, size);
+		_blk_fill += size;
+		if (_blk_fill == _block_size) {
+			_crc.push_back(_blk_crc);
+			_blk_crc = 0;
+			_blk_fill = 0;
+		}
+		ptr += size;
+		remain -= size;
+	}
+
+	/* SHA-256 */
+	uint32_t pending = _sha_len % 64;
+	_sha_len += len;
+	ptr = data;
+	remain = len;
+	if (pending != 0) {
+		uint32_t size = std::min(remain, 64 - pending);
+		memcpy(_sha_buf + pending, ptr, size);
+		ptr += size;
+		remain -= size;
+		if (pending + size < 64)
+			return;
+		sha256_block(_sha_state, _sha_buf);
+	}
+	for (; remain >= 64; ptr += 64, remain -= 64)
+		sha256_block(_sha_state, ptr);
+	memcpy(_sha_buf, ptr, remain);
+}
+
+void FlashManifest::finish()
+{
+	if (_blk_fill != 0) {
+		_crc.push_back(_blk_crc);
+		_blk_crc = 0;
+		_blk_fill = 0;
+	}
+
+	/* padding: 0x80, zeros, length in bits (big endian) */
+	uint32_t pending = _sha_len % 64;
+	const uint64_t bit_len = _sha_len * 8;
+	_sha_buf[pending++] = 0x80;
+	if (pending > 56) {
+		memset(_sha_buf + pending, 0, 64 - pending);
+		sha256_block(_sha_state, _sha_buf);
+		pending = 0;
+	}
+	memset(_sha_buf + pending, 0, 56 - pending);
+	for (int i = 0; i < 8; i++)
+		_sha_buf[56 + i] = (uint8_t)(bit_len >> (56 - 8 * i));
+	sha256_block(_sha_state, _sha_buf);
+
+	std::ostringstream hash;
+	for (int i = 0; i < 8; i++)
+		hash << std::hex << std::setw(8) << std::setfill('0') << _sha_state[i];
+	_sha256 = hash.str();
+}
+
+bool FlashManifest::create(const std::string &filename, uint32_t base_addr,
+		const uint8_t *data, uint32_t len)
+{
+	FlashManifest manifest(base_addr, len);
+	manifest.update(data, len);
+	manifest.finish();
+	return manifest.save(filename);
+}
+
+bool FlashManifest::save(const std::string &filename) const
+{
+	std::ofstream out(filename);
+	if (!out.is_open()) {
+		printError("Error: can't create manifest " + filename);
+		return false;
+	}
+
+	out << "# openFPGALoader flash manifest" << std::endl;
+	out << "base_addr 0x" << std::hex << std::setw(8) << std::setfill('0')
+		<< _base_addr << std::endl;
+	out << "length " << std::dec << _len << std::endl;
+	out << "block_size " << _block_size << std::endl;
+	out << "sha256 " << _sha256 << std::endl;
+	for (size_t i = 0; i < _crc.size(); i++)
+		out << "crc32c " << std::dec << i << " " << std::hex << std::setw(8)
+			<< std::setfill('0') << _crc[i] << std::endl;
+	out.close();
+
+	if (out.fail()) {
+		printError("Error: failed to write manifest " + filename);
+		return false;
+	}
+	printInfo("Manifest stored in " + filename);
+	return true;
+}
+
+bool FlashManifest::load(const std::string &filename)
+{
+	std::ifstream in(filename);
+	if (!in.is_open()) {
+		printError("Error: can't open manifest " + filename);
+		return false;
+	}
+
+	bool has_len = false;
+	_crc.clear();
+	_sha256.clear();
+
+	std::string line;
+	while (std::getline(in, line)) {
+		if (line.empty() || line[0] == '#')
+			continue;
+		std::istringstream iss(line);
+		std::string key;
+		iss >> key;
+		if (key == "base_addr") {
+			iss >> std::hex >> _base_addr;
+		} else if (key == "length") {
+			iss >> std::dec >> _len;
+			has_len = true;
+		} else if (key == "block_size") {
+			iss >> std::dec >> _block_size;
+		} else if (key == "sha256") {
+			iss >> _sha256;
+		} else if (key == "crc32c") {
+			uint32_t idx, crc;
+			iss >> std::dec >> idx >> std::hex >> crc;
+			if (!iss.fail() && idx != _crc.size()) {
+				printError("Error: manifest " + filename +
+					": unordered crc32c entries");
+				return false;
+			}
+			_crc.push_back(crc);
+		} else {
+			printWarn("manifest: unknown entry " + key);
+			continue;
+		}
+		if (iss.fail()) {
+			printError("Error: manifest " + filename + ": malformed line: " +
+				line);
+			return false;
+		}
+	}
+
+	if (!has_len || _block_size == 0 || _sha256.size() != 64 ||
+			_crc.size() != (_len + _block_size - 1) / _block_size) {
+		printError("Error: manifest " + filename + " is incomplete");
+		return false;
+	}
+
+	return true;
+}
+
+bool FlashManifest::compare(const FlashManifest &ref,
+		std::vector<std::pair<uint32_t, uint32_t>> &ranges) const
+{
+	ranges.clear();
+	if (ref._base_addr != _base_addr || ref._len != _len ||
+			ref._block_size != _block_size || ref._crc.size() != _crc.size()) {
+		ranges.push_back(std::make_pair(_base_addr, _len));
+		return false;
+	}
+
+	/* consecutive mismatching blocks are merged */
+	for (size_t i = 0; i < _crc.size(); i++) {
+		if (_crc[i] == ref._crc[i])
+			continue;
+		const uint32_t addr = _base_addr + i * _block_size;
+		const uint32_t size = std::min(_block_size, _len - (uint32_t)(i * _block_size));
+		if (!ranges.empty() &&
+				ranges.back().first + ranges.back().second == addr)
+			ranges.back().second += size;
+		else
+			ranges.push_back(std::make_pair(addr, size));
+	}
+
+	return ranges.empty() && _sha256 == ref._sha256;
+}
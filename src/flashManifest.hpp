@@ -0,0 +1,95 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#ifndef SRC_FLASHMANIFEST_HPP_
+#define SRC_FLASHMANIFEST_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/* default manifest block size (one CRC32C per block) */
+#define FLASH_MANIFEST_BLOCK 0x10000
+
+/*!
+ * \file flashManifest.hpp
+ * \class FlashManifest
+ * \brief flash area fingerprint: SHA-256 of the whole area and one
+ *        CRC32C per block (used to locate mismatching ranges).
+ *        Allows to check a flash without the original image
+ */
+class FlashManifest {
+	public:
+		FlashManifest(uint32_t base_addr = 0, uint32_t len = 0,
+				uint32_t block_size = FLASH_MANIFEST_BLOCK);
+
+		/*!
+		 * \brief compute manifest for data and store it into filename
+		 * \param[in] filename: manifest file
+		 * \param[in] base_addr: flash address of data
+		 * \param[in] data: content
+		 * \param[in] len: data length (in Byte)
+		 * \return false if filename can't be written
+		 */
+		static bool create(const std::string &filename, uint32_t base_addr,
+				const uint8_t *data, uint32_t len);
+
+		/*!
+		 * \brief load manifest from filename
+		 * \return false if file can't be read or is malformed
+		 */
+		bool load(const std::string &filename);
+		/*!
+		 * \brief store manifest into filename
+		 * \return false if file can't be written
+		 */
+		bool save(const std::string &filename) const;
+
+		/*!
+		 * \brief feed next len Byte of the area (hashes are
+		 *        computed on the fly)
+		 */
+		void update(const uint8_t *data, uint32_t len);
+		/*!
+		 * \brief complete hashes (after the last update)
+		 */
+		void finish();
+
+		/*!
+		 * \brief compare with ref (same area and block size)
+		 * \param[out] ranges: mismatching ranges (address, length)
+		 * \return true when both manifests match
+		 */
+		bool compare(const FlashManifest &ref,
+				std::vector<std::pair<uint32_t, uint32_t>> &ranges) const;
+
+		uint32_t base_addr() const { return _base_addr; }
+		uint32_t length() const { return _len; }
+		uint32_t block_size() const { return _block_size; }
+
+		/*!
+		 * \brief CRC32C (Castagnoli) of len Byte, continuing crc
+		 *        (0 for the first call)
+		 */
+		static uint32_t crc32c(uint32_t crc, const uint8_t *data, size_t len);
+
+	private:
+		uint32_t _base_addr;  /**< first flash address */
+		uint32_t _len;        /**< area length (Byte) */
+		uint32_t _block_size; /**< CRC32C block size (Byte) */
+		std::vector<uint32_t> _crc; /**< one CRC32C per block */
+		std::string _sha256;  /**< area SHA-256 (hex) */
+
+		/* update state */
+		uint32_t _sha_state[8]; /**< SHA-256 state */
+		uint8_t _sha_buf[64];   /**< SHA-256 pending block */
+		uint64_t _sha_len;      /**< Byte hashed */
+		uint32_t _blk_crc;      /**< current block CRC32C */
+		uint32_t _blk_fill;     /**< Byte in current block */
+};
+
+#endif  // SRC_FLASHMANIFEST_HPP_
@@ -60,7 +60,7 @@ FtdiJtagBitBang::FtdiJtagBitBang(const cable_t &cable,
 	else if (_pid == 0x6015)  // FT231X
 		_rx_size = 512;
 	else
-		_rx_size = _buffer_size;
+		_rx_size = _max_packet_size;
 
 	/* RX Fifo size (rx: USB -> FTDI)
 	 * is 128 or 256 Byte and MaxPacketSize ~= 64Byte
@@ -43,6 +43,7 @@ class FtdiJtagBitBang : public JtagInterface, private FTDIpp_MPSSE {
 	 * state == one byte)
 	 */
 	int get_buffer_size() override { return _buffer_size/8/2; }
+	std::string get_device_id() override { return usb_device_id(); }
 
 	bool isFull() override { return _num == 8*get_buffer_size();}
 
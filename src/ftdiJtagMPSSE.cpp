@@ -34,7 +34,7 @@ FtdiJtagMPSSE::FtdiJtagMPSSE(const cable_t &cable,
 			const string &dev, const string &serial, uint32_t clkHZ,
 			bool invert_read_edge, int8_t verbose):
 			FTDIpp_MPSSE(cable, dev, serial, clkHZ, verbose), _ch552WA(false),
-			_cmd8EWA(false),
+			_cmd8EWA(false), _batch(false),
 			_write_mode(MPSSE_WRITE_NEG),  // always write on neg edge
 			_read_mode(0),
 			_invert_read_edge(invert_read_edge),  // false: pos, true: neg
@@ -152,6 +152,7 @@ int FtdiJtagMPSSE::writeTMS(const uint8_t *tms, uint32_t len, bool flush_buffer,
 
 			if (_ch552WA) {
 				uint8_t c[len/8+1];
+				mpsse_write_sync();
 				int ret = ftdi_read_data(_ftdi, c, len/8+1);
 				if (ret != 0) {
 					printf("ret : %d\n", ret);
@@ -164,6 +165,7 @@ int FtdiJtagMPSSE::writeTMS(const uint8_t *tms, uint32_t len, bool flush_buffer,
 		mpsse_write();
 	if (_ch552WA) {
 		uint8_t c[len/8+1];
+		mpsse_write_sync();
 		ftdi_read_data(_ftdi, c, len/8+1);
 	}
 
@@ -219,20 +221,75 @@ int FtdiJtagMPSSE::flush()
 	return mpsse_write();
 }
 
+bool FtdiJtagMPSSE::batch_begin()
+{
+	/* CH552 workaround reads answers directly: can't be deferred */
+	if (_ch552WA)
+		return false;
+	_batch = true;
+	return true;
+}
+
+int FtdiJtagMPSSE::batch_execute()
+{
+	_batch = false;
+	if (mpsse_read_flush() < 0)
+		return -1;
+	return mpsse_write();
+}
+
 int FtdiJtagMPSSE::writeTDI(const uint8_t *tdi, uint8_t *tdo, uint32_t len, bool last)
+{
+	return writeTDI(tdi, tdo, len, last, true);
+}
+
+int FtdiJtagMPSSE::writeTDISegs(const shift_seg_t *segs, int nb_segs, bool end)
+{
+	for (int i = 0; i < nb_segs; i++) {
+		const bool is_last = (i == nb_segs - 1);
+		int ret;
+		/* ch552 workaround reads each answer directly */
+		if (segs[i].msb_first && _ch552WA)
+			ret = writeTDIReversed(segs[i].tx, segs[i].rx, segs[i].len,
+				end && is_last);
+		else
+			ret = writeTDI(segs[i].tx, segs[i].rx, segs[i].len,
+				end && is_last, is_last, segs[i].msb_first);
+		if (ret < 0)
+			return -1;
+	}
+	return 0;
+}
+
+int FtdiJtagMPSSE::writeTDIStream(const uint8_t *tx, uint32_t len, bool end,
+		bool msb_first)
+{
+	if (msb_first && _ch552WA)
+		return writeTDIReversed(tx, NULL, len, end);
+	/* buffer is sent when full: no flush between chunks */
+	return writeTDI(tx, NULL, len, end, end, msb_first);
+}
+
+int FtdiJtagMPSSE::writeTDI(const uint8_t *tdi, uint8_t *tdo, uint32_t len,
+		bool last, bool flush, bool msb_first)
 {
 	/* 3 possible case :
 	 *  - n * 8bits to send -> use byte command
 	 *  - less than 8bits   -> use bit command
 	 *  - last bit to send  -> sent in conjunction with TMS
 	 */
-	int tx_buff_size = mpsse_get_buffer_size();
 	int real_len = (last) ? len - 1 : len;  // if its a buffer in a big send send len
 						// else suppress last bit -> with TMS
 	int nb_byte = real_len >> 3;     // number of byte to send
 	int nb_bit = (real_len & 0x07);  // residual bits
-	int xfer = tx_buff_size - 3;
-	unsigned char c[xfer];
+	/* MPSSE command segmentation is independent of the host buffer:
+	 * write only commands use the max MPSSE length (mpsse_store
+	 * flushes when the buffer is full), commands with an answer are
+	 * limited to avoid FTDI FIFO overflow
+	 */
+	int rd_xfer = mpsse_get_read_size();
+	int xfer = (tdo || _ch552WA) ? rd_xfer : MPSSE_MAX_XFER_LEN;
+	unsigned char c[rd_xfer];
 	unsigned char *rx_ptr = (unsigned char *)tdo;
 	unsigned char *tx_ptr = (unsigned char *)tdi;
 	unsigned char tx_buf[3] = {(unsigned char)(MPSSE_LSB |
@@ -255,11 +312,19 @@ int FtdiJtagMPSSE::writeTDI(const uint8_t *tdi, uint8_t *tdo, uint32_t len, bool
 	/* if only one full byte use BITMODE to reduce
 	 * transaction size
 	 */
-	if (nb_byte == 1 && nb_bit == 0) {
+	if (nb_byte == 1 && nb_bit == 0 && !msb_first) {
 		nb_byte = 0;
 		nb_bit = 8;
 	}
 
+	/* MSB first: full bytes are shifted by MPSSE in MSB mode, the
+	 * remaining bits (last byte, sent with TMS) use the LSB path
+	 * with this byte reversed
+	 */
+	uint8_t last_rev = 0;
+	if (msb_first)
+		tx_buf[0] &= ~MPSSE_LSB;
+
 	while (nb_byte != 0) {
 		int xfer_len = (nb_byte > xfer) ? xfer : nb_byte;
 		tx_buf[1] = (((xfer_len - 1)     ) & 0xff);  // low
@@ -270,17 +335,29 @@ int FtdiJtagMPSSE::writeTDI(const uint8_t *tdi, uint8_t *tdo, uint32_t len, bool
 			tx_ptr += xfer_len;
 		}
 		if (tdo) {
-			mpsse_read(rx_ptr, xfer_len);
+			/* answer is collected later: avoid one round trip
+			 * per segment
+			 */
+			mpsse_read_defer(rx_ptr, xfer_len);
 			rx_ptr += xfer_len;
 		} else if (_ch552WA) {
-			mpsse_write();
+			mpsse_write_sync();
 			ftdi_read_data(_ftdi, c, xfer_len);
-		} else if (!last) {
+		} else if (flush && !last && nb_bit == 0 && nb_byte == xfer_len) {
+			/* only flush after the last segment */
 			mpsse_write();
 		}
 		nb_byte -= xfer_len;
 	}
 
+	if (msb_first) {
+		tx_buf[0] |= MPSSE_LSB;
+		if (tdi && (nb_bit != 0 || last)) {
+			reverse_bytes(tx_ptr, &last_rev, 1);
+			tx_ptr = &last_rev;
+		}
+	}
+
 	unsigned char last_bit = (tdi) ? *tx_ptr : 0;
 	// never double write when nb_bit == 0
 	bool double_write = (nb_bit != 0) ? true : false;
@@ -295,36 +372,26 @@ int FtdiJtagMPSSE::writeTDI(const uint8_t *tdi, uint8_t *tdo, uint32_t len, bool
 			mpsse_store(last_bit);
 		}
 		if (tdo && !last) {
-			mpsse_read(rx_ptr, 1);
-			double_write = false;
 			/* realign we have read nb_bit
 			 * since LSB add bit by the left and shift
 			 * we need to complete shift
 			 */
-			*rx_ptr >>= (8 - nb_bit);
-			display("%s %x\n", __func__, *rx_ptr);
+			mpsse_read_defer(rx_ptr, 1, 8 - nb_bit);
+			double_write = false;
 		} else if (_ch552WA) {
 			if (tdo) {
 				mpsse_read(rx_ptr, 1);
 				double_write = false;
 				*rx_ptr >>= (8 - nb_bit);
 			} else {
-				mpsse_write();
+				mpsse_write_sync();
 				ftdi_read_data(_ftdi, c, nb_bit);
 			}
-		} else if (!last) {
+		} else if (!last && flush) {
 			mpsse_write();
 		}
 	}
 
-	/* display : must be dropped */
-	if (_verbose && tdo) {
-		display("\n");
-		for (int i = (len / 8) - 1; i >= 0; i--)
-			display("%x ", (unsigned char)tdo[i]);
-		display("\n");
-	}
-
 	if (last == 1) {
 		last_bit = (tdi)? (*tx_ptr & (1 << nb_bit)) : 0;
 
@@ -337,23 +404,32 @@ int FtdiJtagMPSSE::writeTDI(const uint8_t *tdi, uint8_t *tdo, uint32_t len, bool
 							// and to move to EXIT_XR TMS = 1
 		mpsse_store(tx_buf, 3);
 		if (tdo) {
-			unsigned char c[2];
-			int index = 0;
-			mpsse_read(c, 1 + ((double_write)?1:0));
-			if (double_write) {
-				*rx_ptr = c[index] >> (8-nb_bit);
-				index++;
-			}
+			if (double_write)
+				mpsse_read_defer(rx_ptr, 1, 8 - nb_bit);
 			/* in this case for 1 one it's always bit 7 */
-			*rx_ptr |= (((c[index]) & 0x80) >> (7 - nb_bit));
+			mpsse_read_defer(rx_ptr, 1, 7 - nb_bit, true, msb_first);
 		} else if (_ch552WA) {
-			mpsse_write();
+			mpsse_write_sync();
 			ftdi_read_data(_ftdi, c, 1);
 		} else {
 			mpsse_write();
 		}
 	}
 
+	/* tdo must be filled when returning: collect queued answers
+	 * (in batch mode answers are collected by batch_execute)
+	 */
+	if (tdo && flush && !_batch)
+		mpsse_read_flush();
+
+	/* display : must be dropped */
+	if (_verbose && tdo && flush && !_batch) {
+		display("\n");
+		for (int i = (len / 8) - 1; i >= 0; i--)
+			display("%x ", (unsigned char)tdo[i]);
+		display("\n");
+	}
+
 	return 0;
 }
 
@@ -66,6 +66,15 @@ class FtdiJtagMPSSE : public JtagInterface, public FTDIpp_MPSSE {
 	int toggleClk(uint8_t tms, uint8_t tdi, uint32_t clk_len) override;
 	/* TDI */
 	int writeTDI(const uint8_t *tx, uint8_t *rx, uint32_t len, bool end) override;
+	/* TDI: segments stored in the same command stream */
+	int writeTDISegs(const shift_seg_t *segs, int nb_segs, bool end) override;
+	int writeTDIStream(const uint8_t *tx, uint32_t len, bool end,
+		bool msb_first) override;
+	/*!
+	 * \brief one host buffer per chunk
+	 */
+	uint32_t get_stream_chunk_size() override { return mpsse_get_buffer_size(); }
+	std::string get_device_id() override { return usb_device_id(); }
 
 	/*!
 	 * \brief send TMD and TDI and receive tdo bits;
@@ -87,8 +96,19 @@ class FtdiJtagMPSSE : public JtagInterface, public FTDIpp_MPSSE {
 
 	int flush() override;
 
+	bool batch_begin() override;
+	int batch_execute() override;
+
  private:
 	void init_internal(const mpsse_bit_config &cable);
+	/*!
+	 * \brief writeTDI implementation
+	 * \param flush: send buffer and collect tdo before return. When false
+	 *        commands stay in buffer (next segment follows)
+	 * \param msb_first: bytes are shifted bit 7 first (len multiple of 8)
+	 */
+	int writeTDI(const uint8_t *tx, uint8_t *rx, uint32_t len, bool end,
+		bool flush, bool msb_first = false);
 	/* writeTMSTDI specifics */
 	/*!
 	 * \brief try to append tms buffer, flush content if > 6
@@ -110,6 +130,7 @@ class FtdiJtagMPSSE : public JtagInterface, public FTDIpp_MPSSE {
 	void config_edge();
 	bool _ch552WA; /* avoid errors with SiPeed tangNano */
 	bool _cmd8EWA; /* avoid errors with Sipeed FT2232H emulation */
+	bool _batch; /**< tdo answers are collected by batch_execute */
 	uint8_t _write_mode; /**< write edge configuration */
 	uint8_t _read_mode; /**< read edge configuration */
 	bool _invert_read_edge; /**< read edge selection (false: pos, true: neg) */
@@ -3,7 +3,9 @@
  * Copyright (C) 2019 Gwenhael Goavec-Merou <gwenhael.goavec-merou@trabucayre.com>
  */
 
+#define __STDC_FORMAT_MACROS
 #include <fcntl.h>
+#include <inttypes.h>
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -17,6 +19,7 @@
 #endif
 #include <libusb.h>
 
+#include "common.hpp"
 #include "display.hpp"
 #include "ftdipp_mpsse.hpp"
 
@@ -33,7 +36,11 @@ FTDIpp_MPSSE::FTDIpp_MPSSE(const cable_t &cable, const string &dev,
 				_bus(cable.bus_addr), _addr(cable.device_addr),
 				_bitmode(BITMODE_RESET),
 				_interface(cable.config.interface),
-				_clkHZ(clkHZ), _buffer_size(2*32768), _num(0)
+				_async(false), _xfer_idx(0),
+				_rd_pending(0), _rd_fifo_size(0),
+				_show_stats(verbose > 0), _nb_write_xfer(0), _nb_write_bytes(0),
+				_clkHZ(clkHZ), _buffer_size(MPSSE_DEFAULT_BUFFER_SIZE),
+				_max_packet_size(0), _num(0)
 {
 	libusb_error ret;
 	char err[256];
@@ -54,13 +61,52 @@ FTDIpp_MPSSE::FTDIpp_MPSSE(const cable_t &cable, const string &dev,
 	}
 
 	open_device(serial, 115200);
-	_buffer_size = _ftdi->max_packet_size;
+
+	/* host buffer only bounds how many commands are packed before
+	 * a flush: libusb splits large bulk writes into packets so
+	 * this size is independent of the endpoint max packet size
+	 */
+	_max_packet_size = _ftdi->max_packet_size;
+	if (cable.config.buffer_size > 0) {
+		_buffer_size = cable.config.buffer_size;
+		if (_buffer_size < _max_packet_size)
+			_buffer_size = _max_packet_size;
+		if (_buffer_size > MPSSE_MAX_BUFFER_SIZE) {
+			printWarn("MPSSE buffer size limited to " +
+				std::to_string(MPSSE_MAX_BUFFER_SIZE) + " Bytes");
+			_buffer_size = MPSSE_MAX_BUFFER_SIZE;
+		}
+	}
+
+	/* deferred reads: answers wait in chip TX FIFO until the
+	 * whole command stream is written -> must not exceed its size
+	 */
+	switch (_ftdi->type) {
+	case TYPE_2232H:
+		_rd_fifo_size = 4096;
+		break;
+	case TYPE_4232H:
+		_rd_fifo_size = 2048;
+		break;
+	case TYPE_232H:
+		_rd_fifo_size = 1024;
+		break;
+	default:
+		_rd_fifo_size = 384;
+		break;
+	}
+	if (_rd_fifo_size < mpsse_get_read_size())
+		_rd_fifo_size = mpsse_get_read_size();
 
 	_buffer = (unsigned char *)malloc(sizeof(unsigned char) * _buffer_size);
 	if (!_buffer) {
 		printError("_buffer malloc failed");
 		throw std::runtime_error("_buffer malloc failed");
 	}
+	for (int i = 0; i < MPSSE_NB_XFER_BUFFER; i++) {
+		_xfer_buf[i] = NULL;
+		_xfer_tc[i] = NULL;
+	}
 
 	/* search for iProduct -> need to have
 	 * ftdi->usb_dev (libusb_device_handler) -> libusb_device ->
@@ -119,22 +165,48 @@ FTDIpp_MPSSE::FTDIpp_MPSSE(const cable_t &cable, const string &dev,
 	}
 }
 
+std::string FTDIpp_MPSSE::usb_device_id()
+{
+	struct libusb_device *usb_dev = libusb_get_device(_ftdi->usb_dev);
+	if (!usb_dev)
+		return "";
+
+	char id[32];
+	snprintf(id, sizeof(id), "%04x_%04x_%03d_%03d_", _vid, _pid,
+		libusb_get_bus_number(usb_dev), libusb_get_device_address(usb_dev));
+	return std::string(id) + reinterpret_cast<const char *>(_iserialnumber);
+}
+
 FTDIpp_MPSSE::~FTDIpp_MPSSE()
 {
 	char err[256];
 	int ret;
 
+	/* in flight transfers must be completed before reset */
+	mpsse_write_sync();
+
+	/* throughput: from first write to last transfer completion */
+	if (_show_stats && _nb_write_xfer != 0) {
+		const double elapsed = std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - _first_write).count();
+		printf("%" PRIu64 " Bytes written in %u USB transfers (buffer %d Bytes)"
+			" in %.3fs: %.2f MB/s\n", _nb_write_bytes, _nb_write_xfer,
+			_buffer_size, elapsed,
+			(elapsed > 0) ? _nb_write_bytes / elapsed / 1e6 : 0.0);
+	}
+
 	if (_bitmode == BITMODE_MPSSE) {
 		if (_cable.status_pin != -1) {
 			gpio_set(1 << _cable.status_pin);
 		}
+		mpsse_write_sync();
 	}
 
 	if ((ret = ftdi_set_bitmode(_ftdi, 0, BITMODE_RESET)) < 0) {
 		snprintf(err, sizeof(err), "unable to config pins : %d %s",
 			ret, ftdi_get_error_string(_ftdi));
 		printError(err);
-		free(_buffer);
+		release_buffers();
 		return;
 	}
 
@@ -142,13 +214,25 @@ FTDIpp_MPSSE::~FTDIpp_MPSSE()
 		snprintf(err, sizeof(err), "unable to reset device : %d %s",
 			ret, ftdi_get_error_string(_ftdi));
 		printError(err);
-		free(_buffer);
+		release_buffers();
 		return;
 	}
 
 	if (close_device() == EXIT_FAILURE)
 		printError("unable to close device");
-	free(_buffer);
+	release_buffers();
+}
+
+void FTDIpp_MPSSE::release_buffers()
+{
+	if (!_async) {
+		free(_buffer);
+		return;
+	}
+	/* _buffer points to one of _xfer_buf */
+	for (int i = 0; i < MPSSE_NB_XFER_BUFFER; i++)
+		free(_xfer_buf[i]);
+	_buffer = NULL;
 }
 
 void FTDIpp_MPSSE::open_device(const std::string &serial, unsigned int baudrate)
@@ -354,7 +438,12 @@ int FTDIpp_MPSSE::init(unsigned char latency, unsigned char bitmask_mode,
 		}
 	}
 
-	if (ftdi_read_data_set_chunksize(_ftdi, _buffer_size) < 0) {
+	/* MPSSE: read chunk stay aligned on USB packets, read commands
+	 * are limited to mpsse_get_read_size(). Bitbang: one chunk per
+	 * subclass buffer (as before)
+	 */
+	if (ftdi_read_data_set_chunksize(_ftdi,
+			(mode == BITMODE_MPSSE) ? _max_packet_size : _buffer_size) < 0) {
 		printError("fail to set read chunk size: " +
 				string(ftdi_get_error_string(_ftdi)));
 		return -1;
@@ -365,6 +454,24 @@ int FTDIpp_MPSSE::init(unsigned char latency, unsigned char bitmask_mode,
 		return -1;
 	}
 
+	/* MPSSE mode: buffer is sent asynchronously and the next one
+	 * is filled during transfer. Bitbang mode keeps synchronous
+	 * write (subclass manages its own buffer)
+	 */
+	if (mode == BITMODE_MPSSE && !_async) {
+		_xfer_buf[0] = _buffer;
+		for (int i = 1; i < MPSSE_NB_XFER_BUFFER; i++) {
+			_xfer_buf[i] = (unsigned char *)malloc(sizeof(unsigned char) *
+				_buffer_size);
+			if (!_xfer_buf[i]) {
+				printError("_buffer malloc failed");
+				return -1;
+			}
+		}
+		_xfer_idx = 0;
+		_async = true;
+	}
+
 	_bitmode = mode;
 	return 0;
 }
@@ -432,7 +539,7 @@ int FTDIpp_MPSSE::setClkFreq(uint32_t clkHZ)
 
 	if ((ret = mpsse_store(buffer, 3)) < 0)
 		return ret;
-	if ((ret = mpsse_write()) < 0) {
+	if ((ret = mpsse_write_sync()) < 0) {
 		fprintf(stderr, "Error: write for frequency return %d\n", ret);
 		return ret;
 	}
@@ -516,14 +623,69 @@ int FTDIpp_MPSSE::mpsse_write()
 	display("%s %d\n", __func__, _num);
 #endif
 
-	if ((ret = ftdi_write_data(_ftdi, _buffer, _num)) != _num) {
-		printError("mpsse_write: fail to write with error " +
+	if (_nb_write_xfer == 0)
+		_first_write = std::chrono::steady_clock::now();
+
+	if (!_async) {
+		if ((ret = ftdi_write_data(_ftdi, _buffer, _num)) != _num) {
+			printError("mpsse_write: fail to write with error " +
+					std::to_string(ret) + " (" +
+					string(ftdi_get_error_string(_ftdi)) + ")");
+			return ret;
+		}
+	} else {
+		_xfer_tc[_xfer_idx] = ftdi_write_data_submit(_ftdi, _buffer, _num);
+		if (!_xfer_tc[_xfer_idx]) {
+			printError("mpsse_write: fail to submit transfer (" +
+					string(ftdi_get_error_string(_ftdi)) + ")");
+			return -1;
+		}
+		ret = _num;
+
+		/* switch to next buffer: wait until its previous
+		 * transfer is done
+		 */
+		_xfer_idx = (_xfer_idx + 1) % MPSSE_NB_XFER_BUFFER;
+		_buffer = _xfer_buf[_xfer_idx];
+		if (_xfer_tc[_xfer_idx]) {
+			int r = mpsse_xfer_done(_xfer_idx);
+			if (r < 0)
+				return r;
+		}
+	}
+
+	_nb_write_xfer++;
+	_nb_write_bytes += _num;
+	_num = 0;
+	return ret;
+}
+
+int FTDIpp_MPSSE::mpsse_xfer_done(int idx)
+{
+	int ret = ftdi_transfer_data_done(_xfer_tc[idx]);
+	_xfer_tc[idx] = NULL;
+	if (ret < 0)
+		printError("mpsse_write: transfer failed with error " +
 				std::to_string(ret) + " (" +
 				string(ftdi_get_error_string(_ftdi)) + ")");
+	return ret;
+}
+
+int FTDIpp_MPSSE::mpsse_write_sync()
+{
+	int ret = mpsse_write();
+	if (!_async)
 		return ret;
-	}
 
-	_num = 0;
+	/* oldest transfer first */
+	for (int i = 1; i <= MPSSE_NB_XFER_BUFFER; i++) {
+		int idx = (_xfer_idx + i) % MPSSE_NB_XFER_BUFFER;
+		if (_xfer_tc[idx]) {
+			int r = mpsse_xfer_done(idx);
+			if (r < 0 && ret >= 0)
+				ret = r;
+		}
+	}
 	return ret;
 }
 
@@ -533,6 +695,15 @@ int FTDIpp_MPSSE::mpsse_read(unsigned char *rx_buff, int len)
 	int num_read = 0;
 	unsigned char *p = rx_buff;
 
+	/* answers to queued reads come first: append this one */
+	if (!_rd_queue.empty()) {
+		if ((ret = mpsse_read_defer(rx_buff, len)) < 0)
+			return ret;
+		if ((ret = mpsse_read_flush()) < 0)
+			return ret;
+		return len;
+	}
+
 	/* force buffer transmission before read */
 	if ((ret = mpsse_store(SEND_IMMEDIATE)) < 0) {
 		printError("mpsse_read: fail to store with error: " +
@@ -541,7 +712,7 @@ int FTDIpp_MPSSE::mpsse_read(unsigned char *rx_buff, int len)
 		return ret;
 	}
 
-	if ((ret = mpsse_write()) < 0) {
+	if ((ret = mpsse_write_sync()) < 0) {
 		printError("mpsse_read: fail to flush buffer with error: " +
 				std::to_string(ret) + " (" +
 				string(ftdi_get_error_string(_ftdi)) + ")");
@@ -569,6 +740,58 @@ int FTDIpp_MPSSE::mpsse_read(unsigned char *rx_buff, int len)
 	return num_read;
 }
 
+int FTDIpp_MPSSE::mpsse_read_defer(unsigned char *rx_buff, int len,
+		uint8_t shift, bool msb_or, bool reverse)
+{
+	int ret;
+
+	/* answer can't be stored in FIFO: collect previous ones */
+	if (_rd_pending + len > _rd_fifo_size) {
+		if ((ret = mpsse_read_flush()) < 0)
+			return ret;
+	}
+
+	_rd_queue.push_back({rx_buff, len, shift, msb_or, reverse});
+	_rd_pending += len;
+	return 0;
+}
+
+int FTDIpp_MPSSE::mpsse_read_flush()
+{
+	int ret, offset = 0;
+
+	if (_rd_queue.empty())
+		return 0;
+
+	std::vector<mpsse_rd_t> queue;
+	queue.swap(_rd_queue);
+	int len = _rd_pending;
+	_rd_pending = 0;
+
+	unsigned char rx[len];
+	if ((ret = mpsse_read(rx, len)) != len) {
+		printError("mpsse_read_flush: fail to read " +
+				std::to_string(len) + " Bytes");
+		return (ret < 0) ? ret : -1;
+	}
+
+	/* scatter answers */
+	for (auto &rd : queue) {
+		if (rd.msb_or) {
+			rd.ptr[0] |= (rx[offset] & 0x80) >> rd.shift;
+		} else {
+			memcpy(rd.ptr, rx + offset, rd.len);
+			if (rd.shift)
+				rd.ptr[rd.len - 1] >>= rd.shift;
+		}
+		if (rd.reverse)
+			reverse_bytes(rd.ptr, rd.ptr, rd.len);
+		offset += rd.len;
+	}
+
+	return len;
+}
+
 /**
  * Read GPIO (xCBUSy + xDBUSy) bank
  * @return pins state
@@ -6,10 +6,22 @@
 #ifndef _FTDIPP_MPSSE_H
 #define _FTDIPP_MPSSE_H
 #include <ftdi.h>
+#include <chrono>
 #include <string>
+#include <vector>
 
 #include "cable.hpp"
 
+/* MPSSE clock data commands encode (length - 1) on 16 bits */
+#define MPSSE_MAX_XFER_LEN        0x10000
+/* host side command buffer size (default and upper bound) */
+#define MPSSE_DEFAULT_BUFFER_SIZE 0x10000
+#define MPSSE_MAX_BUFFER_SIZE     0x100000
+/* number of host buffers in MPSSE mode: one is filled
+ * while the others are in flight
+ */
+#define MPSSE_NB_XFER_BUFFER      3
+
 class FTDIpp_MPSSE {
 	public:
 		FTDIpp_MPSSE(const cable_t &cable, const std::string &dev,
@@ -25,6 +37,11 @@ class FTDIpp_MPSSE {
 		int pid() {return _pid;}
 		uint8_t bus_addr()    {return _bus;}
 		uint8_t device_addr() {return _addr;}
+		/*!
+		 * \brief vid, pid, USB bus, address and serial of the
+		 *        opened device
+		 */
+		std::string usb_device_id();
 
 		/* access gpio */
 		/* read gpio */
@@ -55,10 +72,43 @@ class FTDIpp_MPSSE {
 		void ftdi_usb_close_internal();
 		int close_device();
 		int mpsse_write();
+		/*!
+		 * \brief send buffer and wait for completion of all
+		 *        in flight transfers (required before a direct
+		 *        ftdi_read_data or a mode change)
+		 * \return mpsse_write return code
+		 */
+		int mpsse_write_sync();
 		int mpsse_read(unsigned char *rx_buff, int len);
+		/*!
+		 * \brief queue a read: answer is stored in rx_buff by
+		 *        mpsse_read_flush (or next mpsse_read call)
+		 * \param[in] rx_buff: destination (must stay valid until flush)
+		 * \param[in] len: number of bytes to read
+		 * \param[in] shift: right shift applied to the last byte
+		 *             (partial byte read in bit mode)
+		 * \param[in] msb_or: instead of copy, OR bit 7 of the answer
+		 *             (shifted right) into rx_buff[0] (TMS+TDO read)
+		 * \param[in] reverse: reverse bit order of rx_buff bytes once
+		 *             stored (MSB first shift completed LSB first)
+		 * \return 0 on success, < 0 otherwise
+		 */
+		int mpsse_read_defer(unsigned char *rx_buff, int len,
+			uint8_t shift = 0, bool msb_or = false, bool reverse = false);
+		/*!
+		 * \brief send buffer and collect all queued reads in one pass
+		 * \return number of bytes read, < 0 on error
+		 */
+		int mpsse_read_flush();
 		int mpsse_store(unsigned char c);
 		int mpsse_store(unsigned char *c, int len);
 		int mpsse_get_buffer_size() {return _buffer_size;}
+		/*!
+		 * \brief max number of byte a read command may request:
+		 *        answer must fit in FTDI FIFO since the command
+		 *        stream is written before the answer is read
+		 */
+		int mpsse_get_read_size() {return _max_packet_size - 3;}
 		unsigned int udevstufftoint(const char *udevstring, int base);
 		bool search_with_dev(const std::string &device);
 		bool _verbose;
@@ -72,12 +122,37 @@ class FTDIpp_MPSSE {
 		uint8_t _bitmode;
 		char _product[64];
 		unsigned char _interface;
+		/* asynchronous transfers */
+		int mpsse_xfer_done(int idx);
+		void release_buffers();
+		bool _async; /*!< use ftdi_write_data_submit (MPSSE mode) */
+		int _xfer_idx;  /*!< index of the buffer currently filled */
+		unsigned char *_xfer_buf[MPSSE_NB_XFER_BUFFER];
+		struct ftdi_transfer_control *_xfer_tc[MPSSE_NB_XFER_BUFFER];
+		/* deferred reads */
+		struct mpsse_rd_t {
+			unsigned char *ptr;
+			int len;
+			uint8_t shift;
+			bool msb_or;
+			bool reverse;
+		};
+		std::vector<mpsse_rd_t> _rd_queue; /*!< pending reads (in order) */
+		int _rd_pending;   /*!< number of bytes in _rd_queue */
+		int _rd_fifo_size; /*!< chip TX FIFO size: max pending answer */
+		/* statistics */
+		bool _show_stats;         /*!< display statistics at close */
+		uint32_t _nb_write_xfer;  /*!< number of ftdi_write_data calls */
+		uint64_t _nb_write_bytes; /*!< number of bytes sent */
+		/*!< first USB write (throughput) */
+		std::chrono::steady_clock::time_point _first_write;
 		/* gpio */
 		bool __gpio_write(bool low_pins);
 	protected:
 		uint32_t _clkHZ;
 		struct ftdi_context *_ftdi;
-		int _buffer_size;
+		int _buffer_size;     /*!< host side command buffer size */
+		int _max_packet_size; /*!< USB endpoint max packet size */
 		int _num;
 		unsigned char *_buffer;
 		uint8_t _iproduct[200];
@@ -64,7 +64,7 @@ void FtdiSpi::setMode(uint8_t mode)
 }
 
 static cable_t cable = {
-	MODE_FTDI_SERIAL, 0x403, 0x6010, 0, 0, {INTERFACE_B, 0x08, 0x0B, 0x08, 0x0B, 0, -1}
+	MODE_FTDI_SERIAL, 0x403, 0x6010, 0, 0, {INTERFACE_B, 0x08, 0x0B, 0x08, 0x0B, 0, -1, 0}
 };
 
 FtdiSpi::FtdiSpi(int vid, int pid, unsigned char interface, uint32_t clkHZ,
@@ -166,9 +166,12 @@ int FtdiSpi::ft2232_spi_wr_and_rd(//struct ftdi_spi *spi,
 				uint32_t writecnt,
 				const uint8_t * writearr, uint8_t * readarr)
 {
-	uint32_t max_xfer = (readarr) ? _buffer_size : 4096;
-	uint8_t buf[max_xfer];
-	int i = 0;
+	/* read commands are limited to avoid FTDI FIFO overflow,
+	 * write only commands use the max MPSSE length and are
+	 * sent by mpsse_store each time host buffer is full
+	 */
+	uint32_t max_xfer = (readarr) ? mpsse_get_read_size() : MPSSE_MAX_XFER_LEN;
+	uint8_t buf[3];
 	int ret = 0;
 
 	uint8_t *rx_ptr = readarr;
@@ -190,34 +193,36 @@ int FtdiSpi::ft2232_spi_wr_and_rd(//struct ftdi_spi *spi,
 	while (len > 0) {
 		xfer = (len > max_xfer) ? max_xfer : len;
 
-		buf[i++] = ((readarr) ? (MPSSE_DO_READ | _rd_mode) : 0) |
+		buf[0] = ((readarr) ? (MPSSE_DO_READ | _rd_mode) : 0) |
 					((writearr) ? (MPSSE_DO_WRITE | _wr_mode) : 0);
-		buf[i++] = (xfer - 1) & 0xff;
-		buf[i++] = ((xfer - 1) >> 8) & 0xff;
-		if (writearr) {
-			memcpy(buf + i, tx_ptr, xfer);
+		buf[1] = (xfer - 1) & 0xff;
+		buf[2] = ((xfer - 1) >> 8) & 0xff;
+
+		ret = mpsse_store(buf, 3);
+		if (ret == 0 && writearr) {
+			ret = mpsse_store(tx_ptr, xfer);
 			tx_ptr += xfer;
-			i += xfer;
 		}
-
-		ret = mpsse_store(buf, i);
 		if (ret)
 			printf("send_buf failed before read: %i %s\n", ret, ftdi_get_error_string(_ftdi));
-		i = 0;
 		if (readarr) {
-			//if (ret == 0) {
-			ret = mpsse_read(rx_ptr, xfer);
-			if ((uint32_t)ret != xfer)
+			/* answers are collected by block after the loop */
+			ret = mpsse_read_defer(rx_ptr, xfer);
+			if (ret < 0)
 				printf("get_buf failed: %i\n", ret);
-			//}
 			rx_ptr += xfer;
-		} else {
-			ret = mpsse_write();
-			if ((uint32_t)ret != xfer+3)
-				printf("error %d %d\n", ret, i);
 		}
 		len -= xfer;
+	}
 
+	if (readarr) {
+		ret = mpsse_read_flush();
+		if (ret < 0)
+			printf("get_buf failed: %i\n", ret);
+	} else {
+		ret = mpsse_write();
+		if (ret < 0)
+			printf("error %d\n", ret);
 	}
 
 	if (_cs_mode == SPI_CS_AUTO) {
@@ -232,8 +237,13 @@ int FtdiSpi::ft2232_spi_wr_and_rd(//struct ftdi_spi *spi,
 int FtdiSpi::spi_put(uint8_t cmd, const uint8_t *tx, uint8_t *rx, uint32_t len)
 {
 	uint32_t xfer_len = len + 1;
-	uint8_t jtx[xfer_len];
-	uint8_t jrx[xfer_len];
+	/* reused between calls: len may be large (flash read) */
+	if (_spi_tx.size() < xfer_len) {
+		_spi_tx.resize(xfer_len);
+		_spi_rx.resize(xfer_len);
+	}
+	uint8_t *jtx = _spi_tx.data();
+	uint8_t *jrx = _spi_rx.data();
 
 	jtx[0] = cmd;
 	if (tx != NULL)
@@ -78,6 +78,9 @@ class FtdiSpi : public FTDIpp_MPSSE, SPIInterface {
 	uint8_t _cs_mode;
 	uint16_t _holdn;
 	uint16_t _wpn;
+	/* spi_put: command/answer buffers (only grow) */
+	std::vector<uint8_t> _spi_tx;
+	std::vector<uint8_t> _spi_rx;
 };
 
 #endif  // SRC_FTDISPI_HPP_
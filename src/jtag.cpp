@@ -3,7 +3,10 @@
  * Copyright (C) 2020 Gwenhael Goavec-Merou <gwenhael.goavec-merou@trabucayre.com>
  */
 
+#include <algorithm>
+#include <cctype>
 #include <cstring>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <map>
@@ -12,6 +15,7 @@
 #include <vector>
 #include <string>
 
+#include "common.hpp"
 #include "display.hpp"
 #include "jtag.hpp"
 #include "ftdiJtagBitbang.hpp"
@@ -63,13 +67,15 @@ Jtag::Jtag(const cable_t &cable, const jtag_pins_conf_t *pin_conf,
 			const string &serial, uint32_t clkHZ, int8_t verbose,
 			const string &ip_adr, int port,
 			const bool invert_read_edge, const string &firmware_path,
-			const std::map<uint32_t, misc_device> &user_misc_devs):
+			const std::map<uint32_t, misc_device> &user_misc_devs,
+			unsigned max_devices, bool force_detect):
 			_verbose(verbose > 1),
 			_state(RUN_TEST_IDLE),
 			_tms_buffer_size(128), _num_tms(0),
 			_board_name("nope"), _user_misc_devs(user_misc_devs),
 			device_index(0), _dr_bits_before(0), _dr_bits_after(0),
-			_ir_bits_before(0), _ir_bits_after(0), _curr_tdi(1)
+			_ir_bits_before(0), _ir_bits_after(0), _curr_tdi(1),
+			_ir_cache_len(0), _ir_cache_valid(false), _ir_cache_pending(false)
 {
 	switch (cable.type) {
 	case MODE_FTDI_BITBANG:
@@ -101,7 +107,23 @@ Jtag::Jtag(const cable_t &cable, const jtag_pins_conf_t *pin_conf,
 		throw std::runtime_error("Error: memory allocation failed");
 	memset(_tms_buffer, 0, _tms_buffer_size);
 
-	detectChain(32);
+	/* chain topology is cached by opened converter: a valid cache
+	 * avoids a full detection
+	 */
+	const string cache_dir = get_cache_dir();
+	string id = _jtag->get_device_id();
+	if (!cache_dir.empty() && !id.empty()) {
+		for (auto &c : id) {
+			if (!isalnum(c) && c != '_' && c != '-')
+				c = '_';
+		}
+		_chain_cache_file = cache_dir + "/chain_" + id;
+	}
+
+	if (force_detect || !load_chain_cache()) {
+		detectChain(max_devices);
+		save_chain_cache();
+	}
 }
 
 Jtag::~Jtag()
@@ -109,43 +131,87 @@ Jtag::~Jtag()
 	free(_tms_buffer);
 	delete _jtag;
 }
+/* bit n of a LSB first buffer */
+static inline uint8_t get_bit(const std::vector<uint8_t> &buf, unsigned n)
+{
+	return (buf[n >> 3] >> (n & 0x07)) & 0x01;
+}
+
 int Jtag::detectChain(unsigned max_dev)
 {
 	char message[256];
-	uint8_t rx_buff[4];
+	/* each device is at most 32 bits in DR (IDCODE) and IR.
+	 * + 32 to see TDI (all ones) after the last device
+	 */
+	const unsigned scan_len = (max_dev + 1) * 32;
 	/* WA for CH552/tangNano: write is always mandatory */
-	const uint8_t tx_buff[4] = {0xff, 0xff, 0xff, 0xff};
-	uint32_t tmp;
+	std::vector<uint8_t> dr_tx((scan_len + 7) / 8, 0xff);
+	std::vector<uint8_t> dr_rx((scan_len + 7) / 8, 0);
+	/* IR: a single 0 followed by ones: the last 0 seen on TDO
+	 * gives total IR length
+	 */
+	std::vector<uint8_t> ir_tx((scan_len + 7) / 8, 0xff);
+	std::vector<uint8_t> ir_rx((scan_len + 7) / 8, 0);
+	ir_tx[0] = 0xfe;
 
 	/* cleanup */
 	_devices_list.clear();
 	_irlength_list.clear();
 	_ir_bits_before = _ir_bits_after = _dr_bits_before = _dr_bits_after = 0;
+
+	/* after reset each DR is IDCODE (32 bits, LSB=1) or BYPASS (1 bit, 0)
+	 * and each IR capture is xx..01: both scans are shifted in one
+	 * batch and decoded afterward
+	 */
+	_jtag->batch_begin();
 	go_test_logic_reset();
 	set_state(SHIFT_DR);
+	read_write(dr_tx.data(), dr_rx.data(), scan_len, 1);
+	set_state(SHIFT_IR);
+	read_write(ir_tx.data(), ir_rx.data(), scan_len, 1);
+	set_state(TEST_LOGIC_RESET);
+	flushTMS(false);
+	if (_jtag->batch_execute() < 0)
+		throw std::runtime_error("chain scan failed");
 
 	if (_verbose)
 		printInfo("Raw IDCODE:");
 
-	for (unsigned i = 0; i < max_dev; ++i) {
-		read_write(tx_buff, rx_buff, 32, 0);
-		tmp = 0;
-		for (int ii = 0; ii < 4; ++ii)
-			tmp |= (rx_buff[ii] << (8 * ii));
+	/* DR: decode IDCODE/BYPASS bits (first device is the nearest of TDO) */
+	bool end_of_chain = false;
+	unsigned pos = 0;
+	unsigned nb_unknown = 0;
+	while (pos + 32 <= scan_len && _devices_list.size() < max_dev + 1) {
+		/* BYPASS: no IDCODE, irlength must be detected */
+		if (get_bit(dr_rx, pos) == 0) {
+			if (_verbose) {
+				snprintf(message, sizeof(message),
+					"- %zu -> BYPASS (no IDCODE)", _devices_list.size());
+				printInfo(message);
+			}
+			insert_first(0, -1);
+			nb_unknown++;
+			pos++;
+			continue;
+		}
+
+		uint32_t tmp = 0;
+		for (int ii = 0; ii < 32; ++ii)
+			tmp |= (get_bit(dr_rx, pos + ii) << ii);
+		pos += 32;
 
 		if (_verbose) {
-			snprintf(message, sizeof(message), "- %d -> 0x%08x", i, tmp);
+			snprintf(message, sizeof(message), "- %zu -> 0x%08x",
+				_devices_list.size(), tmp);
 			printInfo(message);
 		}
 
-		if (tmp == 0) {
-			throw std::runtime_error("TDO is stuck at 0");
-		}
 		if (tmp == 0xffffffff) {
 			if (_verbose) {
 				snprintf(message, sizeof(message), "Fetched TDI, end-of-chain");
 				printInfo(message);
 			}
+			end_of_chain = true;
 			break;
 		}
 
@@ -166,24 +232,223 @@ int Jtag::detectChain(unsigned max_dev)
 			found = search_and_insert_device_with_idcode(tmp & 0x0fffffff);
 
 		if (!found) {
-			uint16_t mfg = IDCODE2MANUFACTURERID(tmp);
-			uint8_t part = IDCODE2PART(tmp);
-			uint8_t vers = IDCODE2VERS(tmp);
+			/* irlength is deduced from IR scan */
+			insert_first(tmp, -1);
+			nb_unknown++;
+		}
+	}
 
-			char error[1024];
-			snprintf(error, sizeof(error),
-				 "Unknown device with IDCODE: 0x%08x"
-				 " (manufacturer: 0x%03x (%s),"
-				 " part: 0x%02x vers: 0x%x", tmp,
-				 mfg, list_manufacturer[mfg].c_str(), part, vers);
-			throw std::runtime_error(error);
+	if (!end_of_chain) {
+		bool stuck = true;
+		for (auto b : dr_rx)
+			stuck &= (b == 0);
+		if (stuck)
+			throw std::runtime_error("TDO is stuck at 0");
+		throw std::runtime_error("JTAG chain longer than " +
+			std::to_string(max_dev) + " devices");
+	}
+
+	/* IR: total length is the position of the 0 shifted in */
+	int ir_len = -1;
+	for (int i = scan_len - 1; i >= 0; i--) {
+		if (get_bit(ir_rx, i) == 0) {
+			ir_len = i;
+			break;
 		}
 	}
-	set_state(TEST_LOGIC_RESET);
+
+	if (nb_unknown == 0) {
+		if (_verbose && ir_len != -1) {
+			int sum = 0;
+			for (auto l : _irlength_list)
+				sum += l;
+			if (sum != ir_len)
+				printWarn("IR chain length " + std::to_string(ir_len) +
+					" differs from expected " + std::to_string(sum));
+		}
+	} else {
+		resolve_irlength(ir_rx, ir_len, nb_unknown);
+	}
+
 	flushTMS(true);
 	return _devices_list.size();
 }
 
+bool Jtag::load_chain_cache()
+{
+	if (_chain_cache_file.empty())
+		return false;
+
+	std::ifstream fd(_chain_cache_file);
+	if (!fd.is_open())
+		return false;
+
+	std::vector<uint32_t> devices;
+	std::vector<int16_t> irlength;
+	string line;
+	while (std::getline(fd, line)) {
+		if (line.empty() || line[0] == '#')
+			continue;
+		uint32_t idcode;
+		int irlen;
+		if (sscanf(line.c_str(), "%x %d", &idcode, &irlen) != 2 || irlen <= 0)
+			return false;
+		devices.push_back(idcode);
+		irlength.push_back(irlen);
+	}
+	if (devices.empty())
+		return false;
+
+	/* expected DR after reset: IDCODE (32 bits) or BYPASS (1 bit: 0)
+	 * for each device (nearest TDO first), followed by TDI (ones).
+	 * IDCODE version (bits 31:28) is ignored: most devices are stored
+	 * with this nibble masked (see detectChain)
+	 */
+	unsigned len = 32;
+	for (auto id : devices)
+		len += (id == 0) ? 1 : 32;
+	std::vector<uint8_t> tx((len + 7) / 8, 0xff);
+	std::vector<uint8_t> rx((len + 7) / 8, 0);
+	std::vector<uint8_t> exp((len + 7) / 8, 0xff);
+	std::vector<uint8_t> care((len + 7) / 8, 0xff);
+	unsigned pos = 0;
+	for (auto it = devices.rbegin(); it != devices.rend(); it++) {
+		int nb = (*it == 0) ? 1 : 32;
+		for (int i = 0; i < nb; i++, pos++) {
+			if (((*it >> i) & 0x01) == 0)
+				exp[pos >> 3] &= ~(1 << (pos & 0x07));
+			if (i >= 28)
+				care[pos >> 3] &= ~(1 << (pos & 0x07));
+		}
+	}
+
+	go_test_logic_reset();
+	set_state(SHIFT_DR);
+	read_write(tx.data(), rx.data(), len, 1);
+	set_state(TEST_LOGIC_RESET);
+	flushTMS(true);
+
+	/* last byte may be partial */
+	if (len & 0x07)
+		care.back() &= (1 << (len & 0x07)) - 1;
+	for (size_t i = 0; i < rx.size(); i++) {
+		rx[i] &= care[i];
+		exp[i] &= care[i];
+	}
+	if (rx != exp) {
+		if (_verbose)
+			printWarn("chain differs from cache: detect");
+		return false;
+	}
+
+	_devices_list = devices;
+	_irlength_list = irlength;
+	_ir_bits_before = _ir_bits_after = _dr_bits_before = _dr_bits_after = 0;
+	if (_verbose)
+		printInfo("chain loaded from " + _chain_cache_file);
+	return true;
+}
+
+void Jtag::save_chain_cache()
+{
+	if (_chain_cache_file.empty() || _devices_list.empty())
+		return;
+
+	std::ofstream fd(_chain_cache_file, std::ios::trunc);
+	if (!fd.is_open()) {
+		if (_verbose)
+			printWarn("unable to write " + _chain_cache_file);
+		return;
+	}
+
+	fd << "# openFPGALoader JTAG chain cache: idcode irlength" << std::endl;
+	for (size_t i = 0; i < _devices_list.size(); i++)
+		fd << std::hex << std::setw(8) << std::setfill('0') << _devices_list[i]
+			<< " " << std::dec << _irlength_list[i] << std::endl;
+}
+
+/* search irlength for unknown (-1) devices of lens (IR stream order) so
+ * each device capture starts with 01 (LSB first) and chain is ir_len bits
+ * \return number of solutions (search stops at 2)
+ */
+static int search_ir_split(const std::vector<uint8_t> &ir_rx, int ir_len,
+		std::vector<int16_t> &lens, size_t idx, int pos,
+		std::vector<int16_t> &sol)
+{
+	if (idx == lens.size()) {
+		if (pos != ir_len)
+			return 0;
+		sol = lens;
+		return 1;
+	}
+	if (pos + 2 > ir_len || get_bit(ir_rx, pos) != 1 ||
+			get_bit(ir_rx, pos + 1) != 0)
+		return 0;
+
+	if (lens[idx] > 0)
+		return search_ir_split(ir_rx, ir_len, lens, idx + 1,
+			pos + lens[idx], sol);
+
+	int found = 0;
+	for (int len = 2; pos + len <= ir_len && found < 2; len++) {
+		lens[idx] = len;
+		found += search_ir_split(ir_rx, ir_len, lens, idx + 1, pos + len, sol);
+	}
+	lens[idx] = -1;
+	return found;
+}
+
+void Jtag::resolve_irlength(const std::vector<uint8_t> &ir_rx, int ir_len,
+		unsigned nb_unknown)
+{
+	const int nb_dev = _devices_list.size();
+	char error[1024];
+
+	/* IR capture stream starts with the device nearest of TDO (last in
+	 * list)
+	 */
+	std::vector<int16_t> lens(_irlength_list.rbegin(), _irlength_list.rend());
+	std::vector<int16_t> sol;
+	int found = (ir_len < 0) ? 0 :
+		search_ir_split(ir_rx, ir_len, lens, 0, 0, sol);
+
+	if (found != 1) {
+		/* report first device with unknown irlength */
+		int i = 0;
+		while (_irlength_list[i] > 0)
+			i++;
+		uint32_t idcode = _devices_list[i];
+		uint16_t mfg = IDCODE2MANUFACTURERID(idcode);
+		const char *reason = (found == 0) ? "unable to detect" : "ambiguous";
+		if (idcode == 0)
+			snprintf(error, sizeof(error),
+				"Device without IDCODE at index %d: %s IR length"
+				" (%u unknown devices)", i, reason, nb_unknown);
+		else
+			snprintf(error, sizeof(error),
+				"Unknown device with IDCODE: 0x%08x"
+				" (manufacturer: 0x%03x (%s),"
+				" part: 0x%02x vers: 0x%x): %s IR length"
+				" (%u unknown devices)",
+				idcode, mfg, list_manufacturer[mfg].c_str(),
+				IDCODE2PART(idcode), IDCODE2VERS(idcode),
+				reason, nb_unknown);
+		throw std::runtime_error(error);
+	}
+
+	for (int i = 0; i < nb_dev; i++) {
+		if (_irlength_list[i] > 0)
+			continue;
+		_irlength_list[i] = sol[nb_dev - 1 - i];
+		if (_verbose) {
+			snprintf(error, sizeof(error),
+				"- %d -> 0x%08x detected irlength %d", nb_dev - 1 - i,
+				_devices_list[i], _irlength_list[i]);
+			printInfo(error);
+		}
+	}
+}
+
 bool Jtag::search_and_insert_device_with_idcode(uint32_t idcode)
 {
 	int irlength = -1;
@@ -219,6 +484,7 @@ int Jtag::device_select(unsigned index)
 	if (index > _devices_list.size())
 		return -1;
 	device_index = index;
+	_ir_cache_valid = _ir_cache_pending = false;
 	/* get number of devices, in the JTAG chain,
 	 * before the selected one
 	 */
@@ -291,6 +557,7 @@ void Jtag::go_test_logic_reset()
 		setTMS(0x01);
 	flushTMS(false);
 	_state = TEST_LOGIC_RESET;
+	_ir_cache_valid = _ir_cache_pending = false;
 }
 
 int Jtag::read_write(const uint8_t *tdi, unsigned char *tdo, int len, char last)
@@ -302,6 +569,16 @@ int Jtag::read_write(const uint8_t *tdi, unsigned char *tdo, int len, char last)
 	return 0;
 }
 
+int Jtag::read_write(const JtagInterface::shift_seg_t *segs, int nb_segs,
+		char last)
+{
+	flushTMS(false);
+	_jtag->writeTDISegs(segs, nb_segs, last);
+	if (last == 1)
+		_state = (_state == SHIFT_DR) ? EXIT1_DR : EXIT1_IR;
+	return 0;
+}
+
 void Jtag::toggleClk(int nb)
 {
 	unsigned char c = (TEST_LOGIC_RESET == _state) ? 1 : 0;
@@ -312,17 +589,24 @@ void Jtag::toggleClk(int nb)
 	return;
 }
 
-int Jtag::shiftDR(const uint8_t *tdi, unsigned char *tdo, int drlen, tapState_t end_state)
+int Jtag::shiftDR(const uint8_t *tdi, unsigned char *tdo, int drlen,
+		tapState_t end_state, bool msb_first)
 {
+	/* bypass bits before and after payload are sent with it
+	 * as one scan
+	 */
+	JtagInterface::shift_seg_t segs[3];
+	int nb_segs = 0;
+	const bool end = (end_state != SHIFT_DR);
+
 	/* if current state not shift DR
 	 * move to this state
 	 */
 	if (_state != SHIFT_DR) {
 		set_state(SHIFT_DR);
-		flushTMS(false);  // force transmit tms state
 
 		if (_dr_bits_before)
-			read_write(_dr_bits.data(), NULL, _dr_bits_before, false);
+			segs[nb_segs++] = {_dr_bits.data(), NULL, _dr_bits_before, false};
 	}
 
 	/* write tdi (and read tdo) to the selected device
@@ -330,40 +614,113 @@ int Jtag::shiftDR(const uint8_t *tdi, unsigned char *tdo, int drlen, tapState_t
 	 * is the last of the chain and a state change must
 	 * be done
 	 */
-	read_write(tdi, tdo, drlen, _dr_bits_after == 0 && end_state != SHIFT_DR);
+	segs[nb_segs++] = {tdi, tdo, (uint32_t)drlen, msb_first};
+
+	/* if current device is not the last */
+	if (end && _dr_bits_after)
+		segs[nb_segs++] = {_dr_bits.data(), NULL, _dr_bits_after, false};
+
+	read_write(segs, nb_segs, end);
 
-	/* if it's asked to move in FSM */
-	if (end_state != SHIFT_DR) {
-		/* if current device is not the last */
-		if (_dr_bits_after)
-			read_write(_dr_bits.data(), NULL, _dr_bits_after, true);  // its the last force
-								   // tms high with last bit
+	/* if it's asked to move in FSM: move to end_state */
+	if (end)
+		set_state(end_state);
+	return 0;
+}
 
+int Jtag::shiftDR_stream(const std::function<bool(uint8_t *buf,
+		uint32_t offset, uint32_t len)> &producer, uint32_t drlen,
+		tapState_t end_state, bool msb_first)
+{
+	const bool end = (end_state != SHIFT_DR);
+	const uint32_t nb_bytes = (drlen + 7) / 8;
+	uint32_t chunk_size = _jtag->get_stream_chunk_size();
+	if (chunk_size == 0)
+		chunk_size = JTAG_STREAM_CHUNK_SIZE;
+	if (chunk_size > nb_bytes)
+		chunk_size = nb_bytes;
+	std::vector<uint8_t> chunk(chunk_size);
+
+	if (_state != SHIFT_DR) {
+		set_state(SHIFT_DR);
+		if (_dr_bits_before &&
+				_jtag->writeTDIStream(_dr_bits.data(), _dr_bits_before, false,
+					false) < 0)
+			return -1;
+	}
+	flushTMS(false);
+
+	for (uint32_t offset = 0; offset < nb_bytes; offset += chunk_size) {
+		const uint32_t len = std::min(chunk_size, nb_bytes - offset);
+		const bool last_chunk = (offset + len == nb_bytes);
+		const uint32_t nb_bits = (last_chunk) ? drlen - 8 * offset : 8 * len;
+		if (!producer(chunk.data(), offset, len))
+			return -1;
+		if (_jtag->writeTDIStream(chunk.data(), nb_bits,
+				end && last_chunk && !_dr_bits_after, msb_first) < 0)
+			return -1;
+	}
 
-		/* move to end_state */
+	if (end) {
+		if (_dr_bits_after &&
+				_jtag->writeTDIStream(_dr_bits.data(), _dr_bits_after, true,
+					false) < 0)
+			return -1;
+		_state = EXIT1_DR;
 		set_state(end_state);
 	}
+
 	return 0;
 }
 
-int Jtag::shiftIR(unsigned char tdi, int irlen, tapState_t end_state)
+int Jtag::shiftIR(unsigned char tdi, int irlen, tapState_t end_state,
+		bool skip_if_loaded)
 {
 	if (irlen > 8) {
 		cerr << "Error: this method this direct char don't support more than 1 byte" << endl;
 		return -1;
 	}
-	return shiftIR(&tdi, NULL, irlen, end_state);
+	return shiftIR(&tdi, NULL, irlen, end_state, skip_if_loaded);
 }
 
-int Jtag::shiftIR(unsigned char *tdi, unsigned char *tdo, int irlen, tapState_t end_state)
+int Jtag::shiftIR(unsigned char *tdi, unsigned char *tdo, int irlen,
+		tapState_t end_state, bool skip_if_loaded)
 {
+	JtagInterface::shift_seg_t segs[3];
+	int nb_segs = 0;
+	const bool end = (end_state != SHIFT_IR);
+	const bool partial = (_state == SHIFT_IR);
+	const int ir_bytes = (irlen + 7) / 8;
+
+	/* same instruction already loaded: from RUN_TEST_IDLE next DR scan
+	 * is the same with or without this IR scan (except Update-IR)
+	 */
+	if (skip_if_loaded && _ir_cache_valid && !tdo && tdi &&
+			(end_state == RUN_TEST_IDLE || end_state == PAUSE_IR) &&
+			_state == RUN_TEST_IDLE && _ir_cache_len == irlen) {
+		bool same = true;
+		for (int i = 0; i < irlen; i++) {
+			if (((tdi[i >> 3] ^ _ir_cache[i >> 3]) >> (i & 0x07)) & 0x01) {
+				same = false;
+				break;
+			}
+		}
+		if (same)
+			return 0;
+	}
+
+	/* continuing a shift: instruction content is unknown */
+	if (partial || !tdi) {
+		_ir_cache_valid = _ir_cache_pending = false;
+	}
+
 	display("%s: avant shiftIR\n", __func__);
 
 	/* if not in SHIFT IR move to this state */
 	if (_state != SHIFT_IR) {
 		set_state(SHIFT_IR);
 		if (_ir_bits_before)
-			read_write(_ir_bits.data(), NULL, _ir_bits_before, false);
+			segs[nb_segs++] = {_ir_bits.data(), NULL, _ir_bits_before, false};
 	}
 
 	display("%s: envoi ircode\n", __func__);
@@ -373,202 +730,152 @@ int Jtag::shiftIR(unsigned char *tdi, unsigned char *tdo, int irlen, tapState_t
 	 * is the last of the chain and a state change must
 	 * be done
 	 */
-	read_write(tdi, tdo, irlen, _ir_bits_after == 0 && end_state != SHIFT_IR);
-
-	/* it's asked to move out of SHIFT IR state */
-	if (end_state != SHIFT_IR) {
-		/* again if devices after fill '1' */
-		if (_ir_bits_after > 0)
-			read_write(_ir_bits.data(), NULL, _ir_bits_after, true);
-		/* move to the requested state */
-		set_state(end_state);
+	segs[nb_segs++] = {tdi, tdo, (uint32_t)irlen, false};
+
+	/* again if devices after fill '1' */
+	if (end && _ir_bits_after > 0)
+		segs[nb_segs++] = {_ir_bits.data(), NULL, _ir_bits_after, false};
+
+	read_write(segs, nb_segs, end);
+
+	/* loaded when Update-IR is reached */
+	if (end && tdi && !partial) {
+		_ir_cache.assign(tdi, tdi + ir_bytes);
+		_ir_cache_len = irlen;
+		_ir_cache_pending = true;
+		_ir_cache_valid = false;
 	}
 
+	/* it's asked to move out of SHIFT IR state: move to the
+	 * requested state
+	 */
+	if (end)
+		set_state(end_state);
+
 	return 0;
 }
 
+/* shortest TMS sequence between two TAP states
+ * tms: TMS bits (LSB first), len: number of bits
+ */
+struct tap_path_t {
+	uint8_t tms;
+	uint8_t len;
+};
+
+/* [current state][new state], generated by breadth-first search on the
+ * TAP state machine (TMS 0 explored first)
+ */
+static constexpr tap_path_t tap_path[16][16] = {
+	/* from TEST_LOGIC_RESET */
+	{{0x00, 0}, {0x00, 1}, {0x02, 2}, {0x02, 3}, {0x02, 4}, {0x0a, 4}, {0x0a, 5}, {0x2a, 6},
+	 {0x1a, 5}, {0x06, 3}, {0x06, 4}, {0x06, 5}, {0x16, 5}, {0x16, 6}, {0x56, 7}, {0x36, 6}},
+	/* from RUN_TEST_IDLE */
+	{{0x07, 3}, {0x00, 0}, {0x01, 1}, {0x01, 2}, {0x01, 3}, {0x05, 3}, {0x05, 4}, {0x15, 5},
+	 {0x0d, 4}, {0x03, 2}, {0x03, 3}, {0x03, 4}, {0x0b, 4}, {0x0b, 5}, {0x2b, 6}, {0x1b, 5}},
+	/* from SELECT_DR_SCAN */
+	{{0x03, 2}, {0x03, 3}, {0x00, 0}, {0x00, 1}, {0x00, 2}, {0x02, 2}, {0x02, 3}, {0x0a, 4},
+	 {0x06, 3}, {0x01, 1}, {0x01, 2}, {0x01, 3}, {0x05, 3}, {0x05, 4}, {0x15, 5}, {0x0d, 4}},
+	/* from CAPTURE_DR */
+	{{0x1f, 5}, {0x03, 3}, {0x07, 3}, {0x00, 0}, {0x00, 1}, {0x01, 1}, {0x01, 2}, {0x05, 3},
+	 {0x03, 2}, {0x0f, 4}, {0x0f, 5}, {0x0f, 6}, {0x2f, 6}, {0x2f, 7}, {0xaf, 8}, {0x6f, 7}},
+	/* from SHIFT_DR */
+	{{0x1f, 5}, {0x03, 3}, {0x07, 3}, {0x07, 4}, {0x00, 0}, {0x01, 1}, {0x01, 2}, {0x05, 3},
+	 {0x03, 2}, {0x0f, 4}, {0x0f, 5}, {0x0f, 6}, {0x2f, 6}, {0x2f, 7}, {0xaf, 8}, {0x6f, 7}},
+	/* from EXIT1_DR */
+	{{0x0f, 4}, {0x01, 2}, {0x03, 2}, {0x03, 3}, {0x02, 3}, {0x00, 0}, {0x00, 1}, {0x02, 2},
+	 {0x01, 1}, {0x07, 3}, {0x07, 4}, {0x07, 5}, {0x17, 5}, {0x17, 6}, {0x57, 7}, {0x37, 6}},
+	/* from PAUSE_DR */
+	{{0x1f, 5}, {0x03, 3}, {0x07, 3}, {0x07, 4}, {0x01, 2}, {0x05, 3}, {0x00, 0}, {0x01, 1},
+	 {0x03, 2}, {0x0f, 4}, {0x0f, 5}, {0x0f, 6}, {0x2f, 6}, {0x2f, 7}, {0xaf, 8}, {0x6f, 7}},
+	/* from EXIT2_DR */
+	{{0x0f, 4}, {0x01, 2}, {0x03, 2}, {0x03, 3}, {0x00, 1}, {0x02, 2}, {0x02, 3}, {0x00, 0},
+	 {0x01, 1}, {0x07, 3}, {0x07, 4}, {0x07, 5}, {0x17, 5}, {0x17, 6}, {0x57, 7}, {0x37, 6}},
+	/* from UPDATE_DR */
+	{{0x07, 3}, {0x00, 1}, {0x01, 1}, {0x01, 2}, {0x01, 3}, {0x05, 3}, {0x05, 4}, {0x15, 5},
+	 {0x00, 0}, {0x03, 2}, {0x03, 3}, {0x03, 4}, {0x0b, 4}, {0x0b, 5}, {0x2b, 6}, {0x1b, 5}},
+	/* from SELECT_IR_SCAN */
+	{{0x01, 1}, {0x01, 2}, {0x05, 3}, {0x05, 4}, {0x05, 5}, {0x15, 5}, {0x15, 6}, {0x55, 7},
+	 {0x35, 6}, {0x00, 0}, {0x00, 1}, {0x00, 2}, {0x02, 2}, {0x02, 3}, {0x0a, 4}, {0x06, 3}},
+	/* from CAPTURE_IR */
+	{{0x1f, 5}, {0x03, 3}, {0x07, 3}, {0x07, 4}, {0x07, 5}, {0x17, 5}, {0x17, 6}, {0x57, 7},
+	 {0x37, 6}, {0x0f, 4}, {0x00, 0}, {0x00, 1}, {0x01, 1}, {0x01, 2}, {0x05, 3}, {0x03, 2}},
+	/* from SHIFT_IR */
+	{{0x1f, 5}, {0x03, 3}, {0x07, 3}, {0x07, 4}, {0x07, 5}, {0x17, 5}, {0x17, 6}, {0x57, 7},
+	 {0x37, 6}, {0x0f, 4}, {0x0f, 5}, {0x00, 0}, {0x01, 1}, {0x01, 2}, {0x05, 3}, {0x03, 2}},
+	/* from EXIT1_IR */
+	{{0x0f, 4}, {0x01, 2}, {0x03, 2}, {0x03, 3}, {0x03, 4}, {0x0b, 4}, {0x0b, 5}, {0x2b, 6},
+	 {0x1b, 5}, {0x07, 3}, {0x07, 4}, {0x02, 3}, {0x00, 0}, {0x00, 1}, {0x02, 2}, {0x01, 1}},
+	/* from PAUSE_IR */
+	{{0x1f, 5}, {0x03, 3}, {0x07, 3}, {0x07, 4}, {0x07, 5}, {0x17, 5}, {0x17, 6}, {0x57, 7},
+	 {0x37, 6}, {0x0f, 4}, {0x0f, 5}, {0x01, 2}, {0x05, 3}, {0x00, 0}, {0x01, 1}, {0x03, 2}},
+	/* from EXIT2_IR */
+	{{0x0f, 4}, {0x01, 2}, {0x03, 2}, {0x03, 3}, {0x03, 4}, {0x0b, 4}, {0x0b, 5}, {0x2b, 6},
+	 {0x1b, 5}, {0x07, 3}, {0x07, 4}, {0x00, 1}, {0x02, 2}, {0x02, 3}, {0x00, 0}, {0x01, 1}},
+	/* from UPDATE_IR */
+	{{0x07, 3}, {0x00, 1}, {0x01, 1}, {0x01, 2}, {0x01, 3}, {0x05, 3}, {0x05, 4}, {0x15, 5},
+	 {0x0d, 4}, {0x03, 2}, {0x03, 3}, {0x03, 4}, {0x0b, 4}, {0x0b, 5}, {0x2b, 6}, {0x00, 0}},
+};
+
+/* next TAP state: [current state][tms] */
+static constexpr uint8_t tap_next[16][2] = {
+	{Jtag::RUN_TEST_IDLE,  Jtag::TEST_LOGIC_RESET},  // TEST_LOGIC_RESET
+	{Jtag::RUN_TEST_IDLE,  Jtag::SELECT_DR_SCAN},    // RUN_TEST_IDLE
+	{Jtag::CAPTURE_DR,     Jtag::SELECT_IR_SCAN},    // SELECT_DR_SCAN
+	{Jtag::SHIFT_DR,       Jtag::EXIT1_DR},          // CAPTURE_DR
+	{Jtag::SHIFT_DR,       Jtag::EXIT1_DR},          // SHIFT_DR
+	{Jtag::PAUSE_DR,       Jtag::UPDATE_DR},         // EXIT1_DR
+	{Jtag::PAUSE_DR,       Jtag::EXIT2_DR},          // PAUSE_DR
+	{Jtag::SHIFT_DR,       Jtag::UPDATE_DR},         // EXIT2_DR
+	{Jtag::RUN_TEST_IDLE,  Jtag::SELECT_DR_SCAN},    // UPDATE_DR
+	{Jtag::CAPTURE_IR,     Jtag::TEST_LOGIC_RESET},  // SELECT_IR_SCAN
+	{Jtag::SHIFT_IR,       Jtag::EXIT1_IR},          // CAPTURE_IR
+	{Jtag::SHIFT_IR,       Jtag::EXIT1_IR},          // SHIFT_IR
+	{Jtag::PAUSE_IR,       Jtag::UPDATE_IR},         // EXIT1_IR
+	{Jtag::PAUSE_IR,       Jtag::EXIT2_IR},          // PAUSE_IR
+	{Jtag::SHIFT_IR,       Jtag::UPDATE_IR},         // EXIT2_IR
+	{Jtag::RUN_TEST_IDLE,  Jtag::SELECT_DR_SCAN},    // UPDATE_IR
+};
+
+void Jtag::update_ir_cache(uint8_t tms, uint8_t len)
+{
+	uint8_t state = _state;
+	for (int i = 0; i < len; i++) {
+		state = tap_next[state][(tms >> i) & 0x01];
+		if (state == TEST_LOGIC_RESET || state == CAPTURE_IR) {
+			/* IR reset or shift register overwritten */
+			_ir_cache_valid = _ir_cache_pending = false;
+		} else if (state == UPDATE_IR && _ir_cache_pending) {
+			_ir_cache_valid = true;
+			_ir_cache_pending = false;
+		}
+	}
+}
+
 void Jtag::set_state(tapState_t newState, const uint8_t tdi)
 {
 	_curr_tdi = tdi;
-	unsigned char tms = 0;
-	while (newState != _state) {
-		display("_state : %16s(%02d) -> %s(%02d) ",
-			getStateName((tapState_t)_state),
-			_state,
-			getStateName((tapState_t)newState), newState);
-		switch (_state) {
-		case TEST_LOGIC_RESET:
-			if (newState == TEST_LOGIC_RESET) {
-				tms = 1;
-			} else {
-				tms = 0;
-				_state = RUN_TEST_IDLE;
-			}
-			break;
-		case RUN_TEST_IDLE:
-			if (newState == RUN_TEST_IDLE) {
-				tms = 0;
-			} else {
-				tms = 1;
-				_state = SELECT_DR_SCAN;
-			}
-			break;
-		case SELECT_DR_SCAN:
-			switch (newState) {
-			case CAPTURE_DR:
-			case SHIFT_DR:
-			case EXIT1_DR:
-			case PAUSE_DR:
-			case EXIT2_DR:
-			case UPDATE_DR:
-				tms = 0;
-				_state = CAPTURE_DR;
-				break;
-			default:
-				tms = 1;
-				_state = SELECT_IR_SCAN;
-			}
-			break;
-		case SELECT_IR_SCAN:
-			switch (newState) {
-			case CAPTURE_IR:
-			case SHIFT_IR:
-			case EXIT1_IR:
-			case PAUSE_IR:
-			case EXIT2_IR:
-			case UPDATE_IR:
-				tms = 0;
-				_state = CAPTURE_IR;
-				break;
-			default:
-				tms = 1;
-				_state = TEST_LOGIC_RESET;
-			}
-			break;
-			/* DR column */
-		case CAPTURE_DR:
-			if (newState == SHIFT_DR) {
-				tms = 0;
-				_state = SHIFT_DR;
-			} else {
-				tms = 1;
-				_state = EXIT1_DR;
-			}
-			break;
-		case SHIFT_DR:
-			if (newState == SHIFT_DR) {
-				tms = 0;
-			} else {
-				tms = 1;
-				_state = EXIT1_DR;
-			}
-			break;
-		case EXIT1_DR:
-			switch (newState) {
-			case PAUSE_DR:
-			case EXIT2_DR:
-			case SHIFT_DR:
-			case EXIT1_DR:
-				tms = 0;
-				_state = PAUSE_DR;
-				break;
-			default:
-				tms = 1;
-				_state = UPDATE_DR;
-			}
-			break;
-		case PAUSE_DR:
-			if (newState == PAUSE_DR) {
-				tms = 0;
-			} else {
-				tms = 1;
-				_state = EXIT2_DR;
-			}
-			break;
-		case EXIT2_DR:
-			switch (newState) {
-			case SHIFT_DR:
-			case EXIT1_DR:
-			case PAUSE_DR:
-				tms = 0;
-				_state = SHIFT_DR;
-				break;
-			default:
-				tms = 1;
-				_state = UPDATE_DR;
-			}
-			break;
-		case UPDATE_DR:
-		case UPDATE_IR:
-			if (newState == RUN_TEST_IDLE) {
-				tms = 0;
-				_state = RUN_TEST_IDLE;
-			} else {
-				tms = 1;
-				_state = SELECT_DR_SCAN;
-			}
-			break;
-			/* IR column */
-		case CAPTURE_IR:
-			if (newState == SHIFT_IR) {
-				tms = 0;
-				_state = SHIFT_IR;
-			} else {
-				tms = 1;
-				_state = EXIT1_IR;
-			}
-			break;
-		case SHIFT_IR:
-			if (newState == SHIFT_IR) {
-				tms = 0;
-			} else {
-				tms = 1;
-				_state = EXIT1_IR;
-			}
-			break;
-		case EXIT1_IR:
-			switch (newState) {
-			case PAUSE_IR:
-			case EXIT2_IR:
-			case SHIFT_IR:
-			case EXIT1_IR:
-				tms = 0;
-				_state = PAUSE_IR;
-				break;
-			default:
-				tms = 1;
-				_state = UPDATE_IR;
-			}
-			break;
-		case PAUSE_IR:
-			if (newState == PAUSE_IR) {
-				tms = 0;
-			} else {
-				tms = 1;
-				_state = EXIT2_IR;
-			}
-			break;
-		case EXIT2_IR:
-			switch (newState) {
-			case SHIFT_IR:
-			case EXIT1_IR:
-			case PAUSE_IR:
-				tms = 0;
-				_state = SHIFT_IR;
-				break;
-			default:
-				tms = 1;
-				_state = UPDATE_IR;
-			}
-			break;
-		case UNKNOWN:;
-			// UNKNOWN should not be valid...
-			throw std::exception();
-		}
+	if (_state == UNKNOWN || newState == UNKNOWN)
+		// UNKNOWN should not be valid...
+		throw std::exception();
 
-		setTMS(tms);
-		display("%d %d %d %x\n", tms, _num_tms-1, _state,
-			_tms_buffer[(_num_tms-1) / 8]);
+	const tap_path_t &path = tap_path[_state][newState];
+	display("_state : %16s(%02d) -> %s(%02d) tms %02x len %d\n",
+		getStateName((tapState_t)_state), _state,
+		getStateName((tapState_t)newState), newState,
+		path.tms, path.len);
+
+	if (path.len != 0) {
+		if (_ir_cache_valid || _ir_cache_pending)
+			update_ir_cache(path.tms, path.len);
+		if (_num_tms == 0) {
+			/* nothing pending: send path directly */
+			_jtag->writeTMS(&path.tms, path.len, false, _curr_tdi);
+		} else {
+			for (int i = 0; i < path.len; i++)
+				setTMS((path.tms >> i) & 0x01);
+		}
+		_state = newState;
 	}
 	/* force write buffer */
 	flushTMS(false);
@@ -7,6 +7,7 @@
 #define SRC_JTAG_HPP_
 
 #include <cstdint>
+#include <functional>
 #include <iostream>
 #include <map>
 #include <string>
@@ -17,6 +18,11 @@
 #include "jtagInterface.hpp"
 #include "part.hpp"
 
+/* default max number of devices in chain scanned by detectChain */
+#define JTAG_MAX_DEVICES 256
+/* upper bound for the user provided max number of devices */
+#define JTAG_MAX_DEVICES_LIMIT 65536
+
 class Jtag {
  public:
 	Jtag(const cable_t &cable, const jtag_pins_conf_t *pin_conf,
@@ -25,7 +31,9 @@ class Jtag {
 		const std::string &ip_adr, int port,
 		const bool invert_read_edge = false,
 		const std::string &firmware_path = "",
-		const std::map<uint32_t, misc_device> &user_misc_devs = {});
+		const std::map<uint32_t, misc_device> &user_misc_devs = {},
+		unsigned max_devices = JTAG_MAX_DEVICES,
+		bool force_detect = false);
 	~Jtag();
 
 	/* maybe to update */
@@ -56,7 +64,11 @@ class Jtag {
 	/*!
 	 * \brief scan JTAG chain to obtain IDCODE. Fill
 	 *        a vector with all idcode and another
-	 *        vector with irlength
+	 *        vector with irlength. DR and IR are scanned
+	 *        in one pass: devices without IDCODE (BYPASS, listed
+	 *        with idcode 0) or unknown have their irlength deduced
+	 *        from IR capture
+	 * \param[in] max_dev: max number of devices in chain
 	 * \return number of devices found
 	 */
 	int detectChain(unsigned int max_dev);
@@ -67,6 +79,12 @@ class Jtag {
 	 */
 	std::vector<uint32_t> get_devices_list() {return _devices_list;}
 
+	/*!
+	 * \brief return irlength of devices in the chain
+	 * \return list of irlength (same order as get_devices_list)
+	 */
+	std::vector<int16_t> get_irlength_list() {return _irlength_list;}
+
 	/*!
 	 * \brief return device index in list
 	 * \return device index
@@ -119,19 +137,78 @@ class Jtag {
 		UNKNOWN = 16,
 	};
 
+	/*!
+	 * \brief shift an instruction to the selected device
+	 * \param[in] tdi: instruction
+	 * \param[out] tdo: captured IR (may be NULL)
+	 * \param[in] irlen: instruction length
+	 * \param[in] end_state: state to reach after shift
+	 * \param[in] skip_if_loaded: when the same instruction is already
+	 *            loaded (no reset or IR capture since) and TAP is in
+	 *            RUN_TEST_IDLE, the scan is elided (TAP stays in
+	 *            RUN_TEST_IDLE). Only for instructions without side
+	 *            effect on Update-IR
+	 */
 	int shiftIR(unsigned char *tdi, unsigned char *tdo, int irlen,
-		tapState_t end_state = RUN_TEST_IDLE);
+		tapState_t end_state = RUN_TEST_IDLE, bool skip_if_loaded = false);
 	int shiftIR(unsigned char tdi, int irlen,
-		tapState_t end_state = RUN_TEST_IDLE);
+		tapState_t end_state = RUN_TEST_IDLE, bool skip_if_loaded = false);
+	/*!
+	 * \brief shift data to the selected device
+	 * \param[in] tdi: data (may be NULL)
+	 * \param[out] tdo: captured data (may be NULL)
+	 * \param[in] drlen: data length (bits)
+	 * \param[in] end_state: state to reach after shift
+	 * \param[in] msb_first: tdi/tdo bytes are shifted bit 7 first (drlen
+	 *            must be a multiple of 8). Done by the converter when
+	 *            supported, by a reversed copy otherwise
+	 */
 	int shiftDR(const uint8_t *tdi, unsigned char *tdo, int drlen,
-		tapState_t end_state = RUN_TEST_IDLE);
+		tapState_t end_state = RUN_TEST_IDLE, bool msb_first = false);
+	/*!
+	 * \brief shift a large write only payload as one DR scan. Data are
+	 *        requested chunk by chunk (chunk size is given by the
+	 *        converter) and TAP stays in SHIFT_DR between chunks
+	 * \param[in] producer: fill buf with len bytes starting at byte
+	 *            offset of the payload, false to abort (TAP stays
+	 *            in SHIFT_DR)
+	 * \param[in] drlen: payload length (bits)
+	 * \param[in] end_state: state to reach after shift
+	 * \param[in] msb_first: bytes are shifted bit 7 first (see shiftDR)
+	 * \return 0 on success, -1 otherwise
+	 */
+	int shiftDR_stream(const std::function<bool(uint8_t *buf,
+		uint32_t offset, uint32_t len)> &producer, uint32_t drlen,
+		tapState_t end_state = RUN_TEST_IDLE, bool msb_first = false);
 	int read_write(const uint8_t *tdi, unsigned char *tdo, int len, char last);
+	/*!
+	 * \brief shift segments as one contiguous scan
+	 * \param[in] segs: segments (bypass bits, payload)
+	 * \param[in] nb_segs: number of segments
+	 * \param[in] last: move to EXIT1 with the last bit
+	 */
+	int read_write(const JtagInterface::shift_seg_t *segs, int nb_segs,
+		char last);
 
 	void toggleClk(int nb);
 	void go_test_logic_reset();
 	void set_state(tapState_t newState, const uint8_t tdi = 1);
 	int flushTMS(bool flush_buffer = false);
 	void flush() {flushTMS(); _jtag->flush();}
+
+	/*!
+	 * \brief start a batch of scans: shiftIR/shiftDR, set_state and
+	 *        toggleClk are queued and tdo buffers are only filled
+	 *        by batch_execute (they must stay valid until then)
+	 * \return false if converter doesn't support it (scans are
+	 *         executed immediately, batch_execute is still required)
+	 */
+	bool batch_begin() { return _jtag->batch_begin(); }
+	/*!
+	 * \brief send queued scans in one flush and collect tdo
+	 * \return < 0 if something wrong
+	 */
+	int batch_execute() { flushTMS(false); return _jtag->batch_execute(); }
 	void setTMS(unsigned char tms);
 
 	const char *getStateName(tapState_t s);
@@ -150,6 +227,31 @@ class Jtag {
 	 * \return false if not found, true otherwise
 	 */
 	bool search_and_insert_device_with_idcode(uint32_t idcode);
+	/*!
+	 * \brief load chain (idcode and irlength) from cache file and check
+	 *        it with a single DR scan (IDCODE/BYPASS pattern)
+	 * \return false if no cache or chain differs
+	 */
+	bool load_chain_cache();
+	/*!
+	 * \brief store detected chain in cache file
+	 */
+	void save_chain_cache();
+	std::string _chain_cache_file; /*!< chain cache path ("": disabled) */
+	/*!
+	 * \brief track instruction register content while moving
+	 *        from _state following tms path
+	 */
+	void update_ir_cache(uint8_t tms, uint8_t len);
+	/*!
+	 * \brief deduce irlength of devices with unknown irlength (-1)
+	 *        from IR capture (each device capture is xx..01)
+	 * \param[in] ir_rx: IR capture (nearest TDO device first)
+	 * \param[in] ir_len: total IR length (-1 if not found)
+	 * \param[in] nb_unknown: number of devices with unknown irlength
+	 */
+	void resolve_irlength(const std::vector<uint8_t> &ir_rx, int ir_len,
+		unsigned nb_unknown);
 	bool _verbose;
 	tapState_t _state;
 	int _tms_buffer_size;
@@ -172,5 +274,11 @@ class Jtag {
 	std::vector<uint32_t> _devices_list; /*!< ordered list of devices idcode */
 	std::vector<int16_t> _irlength_list; /*!< ordered list of irlength */
 	uint8_t _curr_tdi;
+
+	/* instruction cache (selected device) */
+	std::vector<uint8_t> _ir_cache; /*!< last instruction shifted */
+	int _ir_cache_len;     /*!< its length (bits) */
+	bool _ir_cache_valid;   /*!< _ir_cache is loaded (Update-IR done) */
+	bool _ir_cache_pending; /*!< _ir_cache shifted, Update-IR not done */
 };
 #endif  // SRC_JTAG_HPP_
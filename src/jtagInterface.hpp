@@ -8,8 +8,14 @@
 
 #include <cstdint>
 #include <iostream>
+#include <string>
 #include <vector>
 
+#include "common.hpp"
+
+/* default chunk size (in byte) used by Jtag::shiftDR_stream */
+#define JTAG_STREAM_CHUNK_SIZE 0x10000
+
 /*!
  * \file JtagInterface.hpp
  * \class JtagInterface
@@ -65,6 +71,63 @@ class JtagInterface {
 	 * \return number of bit written and/or read
 	 */
 	virtual int writeTDI(const uint8_t *tx, uint8_t *rx, uint32_t len, bool end) = 0;
+
+	/*!
+	 * \brief one segment of a scatter/gather shift
+	 */
+	struct shift_seg_t {
+		const uint8_t *tx; /*!< TDI values (may be NULL) */
+		uint8_t *rx;       /*!< TDO values (may be NULL) */
+		uint32_t len;      /*!< number of bits */
+		bool msb_first;    /*!< tx/rx bytes are shifted bit 7 first
+		                    *   (len must be a multiple of 8) */
+	};
+	/*!
+	 * \brief send a serie of segments as one contiguous scan (ie. bypass
+	 *        bits and payload) without intermediate flush
+	 * \param segs: segments list
+	 * \param nb_segs: number of segments
+	 * \param end: last bit of last segment is sent with TMS high
+	 * \return < 0 if something wrong
+	 */
+	virtual int writeTDISegs(const shift_seg_t *segs, int nb_segs, bool end)
+	{
+		for (int i = 0; i < nb_segs; i++) {
+			const bool last = end && i == nb_segs - 1;
+			int ret = (segs[i].msb_first) ?
+				writeTDIReversed(segs[i].tx, segs[i].rx, segs[i].len, last) :
+				writeTDI(segs[i].tx, segs[i].rx, segs[i].len, last);
+			if (ret < 0)
+				return -1;
+		}
+		return 0;
+	}
+	/*!
+	 * \brief write one chunk of a long write only scan: converter may keep
+	 *        data in its buffer (sent when full or with the last chunk)
+	 * \param tx: TDI values
+	 * \param len: number of bits
+	 * \param end: last chunk: last bit is sent with TMS high
+	 * \param msb_first: bytes are shifted bit 7 first
+	 * \return < 0 if something wrong
+	 */
+	virtual int writeTDIStream(const uint8_t *tx, uint32_t len, bool end,
+		bool msb_first)
+	{
+		if (msb_first)
+			return writeTDIReversed(tx, NULL, len, end);
+		return writeTDI(tx, NULL, len, end);
+	}
+	/*!
+	 * \brief preferred chunk size (in byte) for long write only scans
+	 * \return chunk size
+	 */
+	virtual uint32_t get_stream_chunk_size() { return JTAG_STREAM_CHUNK_SIZE; }
+	/*!
+	 * \brief identifier of the opened converter (chain cache key)
+	 * \return empty string when the converter can't be identified
+	 */
+	virtual std::string get_device_id() { return ""; }
 	/*!
 	 * \brief send TMD and TDI and receive tdo bits;
 	 * \param tms: array of TMS values (used to write)
@@ -103,7 +166,51 @@ class JtagInterface {
 	 */
 	virtual int flush() = 0;
 
+	/*!
+	 * \brief start a batch: following writeTDI may return before tdo
+	 *        buffers are filled. Buffers must stay valid until
+	 *        batch_execute
+	 * \return false when converter doesn't support deferred reads
+	 *         (writeTDI stays synchronous)
+	 */
+	virtual bool batch_begin() { return false; }
+
+	/*!
+	 * \brief send all queued commands in one pass and fill every tdo
+	 *        buffer given since batch_begin
+	 * \return < 0 if something wrong
+	 */
+	virtual int batch_execute() { return flush(); }
+
  protected:
+	/*!
+	 * \brief MSB first fallback for converters shifting LSB first only:
+	 *        tx is reversed to a temporary buffer and rx is reversed
+	 *        when writeTDI returns (not compatible with batch mode)
+	 * \param tx: TDI values (may be NULL)
+	 * \param rx: TDO values (may be NULL)
+	 * \param len: number of bits (multiple of 8)
+	 * \param end: last bit is sent with TMS high
+	 * \return writeTDI return code
+	 */
+	int writeTDIReversed(const uint8_t *tx, uint8_t *rx, uint32_t len,
+		bool end)
+	{
+		const uint32_t nb_bytes = (len + 7) / 8;
+		std::vector<uint8_t> rev_tx, rev_rx;
+		if (tx) {
+			rev_tx.resize(nb_bytes);
+			reverse_bytes(tx, rev_tx.data(), nb_bytes);
+		}
+		if (rx)
+			rev_rx.resize(nb_bytes);
+		int ret = writeTDI((tx) ? rev_tx.data() : NULL,
+			(rx) ? rev_rx.data() : NULL, len, end);
+		if (rx)
+			reverse_bytes(rev_rx.data(), rx, nb_bytes);
+		return ret;
+	}
+
 	uint32_t _clkHZ; /*!< current clk frequency */
 };
 #endif  // SRC_JTAGINTERFACE_HPP_
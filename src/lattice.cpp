@@ -12,8 +12,13 @@
 #include <string.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
 #include <iostream>
+#include <mutex>
 #include <stdexcept>
+#include <thread>
 
 #include "jtag.hpp"
 #include "lattice.hpp"
@@ -140,12 +145,28 @@ using namespace std;
 
 #define PUBKEY_LENGTH_BYTES				64			/* length of the public key (MachXO3D) in bytes */
 
+/* flashProg: number of pages programmed before busy flag/status check */
+#define LATTICE_PROG_BURST  256
+/* Verify: number of pages read per transfer */
+#define LATTICE_VERIFY_BURST  256
+
+/* spi_wait: status register samples read per scan */
+#define SPI_WAIT_BURST_MIN  8
+#define SPI_WAIT_BURST_MAX  512
+
 Lattice::Lattice(Jtag *jtag, const string filename, const string &file_type,
-	Device::prog_type_t prg_type, std::string flash_sector, bool verify, int8_t verbose, bool skip_load_bridge, bool skip_reset):
+	Device::prog_type_t prg_type, std::string flash_sector, bool verify, int8_t verbose, bool skip_load_bridge, bool skip_reset,
+	bool transparent, bool ufm_only, bool flash_diff,
+	const std::string &flash_manifest):
 		Device(jtag, filename, file_type, verify, verbose),
-		SPIInterface(filename, verbose, 0, verify, skip_load_bridge, skip_reset),
-		_fpga_family(UNKNOWN_FAMILY), _flash_sector(LATTICE_FLASH_UNDEFINED)
+		SPIInterface(filename, verbose, 0, verify, skip_load_bridge, skip_reset,
+			flash_diff),
+		_fpga_family(UNKNOWN_FAMILY), _burst_prog(true),
+		_transparent(transparent), _ufm_only(ufm_only),
+		_flash_sector(LATTICE_FLASH_UNDEFINED)
 {
+	memset(_op_stats, 0, sizeof(_op_stats));
+	set_manifest(flash_manifest);
 	if (prg_type == Device::RD_FLASH) {
 		_mode = READ_MODE;
 	} else if (!_file_extension.empty()) {
@@ -157,7 +178,7 @@ Lattice::Lattice(Jtag *jtag, const string filename, const string &file_type,
 			else
 				_mode = Device::MEM_MODE;
 		} else { /* unknown type: */
-			if (prg_type == Device::WR_FLASH) /* to flash: OK */
+			if (prg_type == Device::WR_FLASH || _ufm_only) /* to flash: OK */
 				_mode = Device::FLASH_MODE;
 			else /* otherwise: KO */
 				throw std::runtime_error("incompatible file format");
@@ -213,6 +234,41 @@ Lattice::Lattice(Jtag *jtag, const string filename, const string &file_type,
 		printError("Unknown device family");
 		throw std::exception();
 	}
+
+	if (_transparent && _fpga_family != MACHXO2_FAMILY &&
+			_fpga_family != MACHXO3_FAMILY &&
+			_fpga_family != MACHXO3D_FAMILY)
+		throw std::runtime_error("transparent mode is only supported "
+			"by MachXO2/MachXO3 families");
+	/* MachXO3D UFM sectors are selected with flash_sector */
+	if (_ufm_only && _fpga_family != MACHXO2_FAMILY &&
+			_fpga_family != MACHXO3_FAMILY)
+		throw std::runtime_error("UFM only write is only supported "
+			"by MachXO2/MachXO3 families");
+	if (_ufm_only && _file_extension == "bit")
+		throw std::runtime_error("UFM only write requires a JEDEC or "
+			"raw file");
+}
+
+Lattice::~Lattice()
+{
+	static const char *op_name[LATTICE_OP_NB] = {
+		"ISC", "SRAM erase", "flash erase", "page program", "refresh",
+		"command"
+	};
+
+	if (!_verbose)
+		return;
+
+	/* measured durations: used to tune timing model */
+	for (int i = 0; i < LATTICE_OP_NB; i++) {
+		const lattice_op_stat_t &st = _op_stats[i];
+		if (st.count == 0)
+			continue;
+		printf("%-13s: %6u ops, avg %8" PRIu64 " us, max %8" PRIu64
+			" us, %6u busy polls\n", op_name[i], st.count,
+			st.total_us / st.count, st.max_us, st.polls);
+	}
 }
 
 void displayFeabits(uint16_t _featbits)
@@ -328,12 +384,13 @@ bool Lattice::program_mem()
 		if (!checkStatus(0, REG_STATUS_PRV_CNF_CHK_MASK)) {
 			printInfo("Error in previous bitstream execution. REFRESH: ", false);
 			wr_rd(REFRESH, NULL, 0, NULL, 0);
-			_jtag->set_state(Jtag::RUN_TEST_IDLE);
-			_jtag->toggleClk(1000);
 			/* In Lattice FPGA-TN-02099 document in a note it's reported that there
 				 is a delay time after LSC_REFRESH where "Duration could be in
 				 seconds". Without whis waiting time, busy flag can't be cleared.*/
-			sleep(5);
+			if (!wait_op(LATTICE_OP_REFRESH)) {
+				printError("FAIL");
+				return false;
+			}
 			was_refreshed = true;
 			if (!checkStatus(0, REG_STATUS_PRV_CNF_CHK_MASK)) {
 				printError("FAIL");
@@ -367,18 +424,14 @@ bool Lattice::program_mem()
 		printInfo("Configuration Logic Reset: ", false);
 		uint8_t tx_tmp[1] = {0x08};
 		wr_rd(LSC_DEVICE_CONTROL, tx_tmp, 1, NULL, 0);
-		_jtag->set_state(Jtag::RUN_TEST_IDLE);
-		_jtag->toggleClk(1000);
-		if(!pollBusyFlag()) {
+		if (!wait_op(LATTICE_OP_ISC)) {
 			printError("FAIL");
 			return false;
 		}
 
 		tx_tmp[0] = 0x00;
 		wr_rd(LSC_DEVICE_CONTROL, tx_tmp, 1, NULL, 0);
-		_jtag->set_state(Jtag::RUN_TEST_IDLE);
-		_jtag->toggleClk(1000);
-		if(!pollBusyFlag()) {
+		if (!wait_op(LATTICE_OP_ISC)) {
 			printError("FAIL");
 			return false;
 		}
@@ -403,8 +456,7 @@ bool Lattice::program_mem()
 
 	/* LSC_INIT_ADDRESS */
 	wr_rd(0x46, NULL, 0, NULL, 0);
-	_jtag->set_state(Jtag::RUN_TEST_IDLE);
-	_jtag->toggleClk(1000);
+	wait_op(LATTICE_OP_CMD, true);
 
 	const uint8_t *data = _bit.getData();
 	int length = _bit.getLength()/8;
@@ -412,28 +464,20 @@ bool Lattice::program_mem()
 	_jtag->set_state(Jtag::RUN_TEST_IDLE);
 	_jtag->toggleClk(2);
 
-	uint8_t tmp[1024];
-	int size = 1024;
-	Jtag::tapState_t next_state = Jtag::SHIFT_DR;
-
 	ProgressBar progress("Loading", length, 50, _quiet);
 
-	for (int i = 0; i < length; i += size) {
-		progress.display(i);
-
-		if (length < i + size) {
-			size = length-i;
-			next_state = Jtag::RUN_TEST_IDLE;
-		}
-
-		for (int ii = 0; ii < size; ii++)
-			tmp[ii] = ConfigBitstreamParser::reverseByte(data[i+ii]);
-
-		_jtag->shiftDR(tmp, NULL, size*8, next_state);
+	/* whole bitstream in one scan, bytes are shifted MSB first */
+	if (_jtag->shiftDR_stream([&](uint8_t *buf, uint32_t offset, uint32_t len) {
+			progress.display(offset);
+			memcpy(buf, data + offset, len);
+			return true;
+		}, length * 8, Jtag::RUN_TEST_IDLE, true) < 0) {
+		progress.fail();
+		printError("Error: failed to send bitstream");
+		return false;
 	}
 
-	_jtag->set_state(Jtag::RUN_TEST_IDLE);
-	_jtag->toggleClk(1000);
+	wait_op(LATTICE_OP_CMD, true);
 
 	uint32_t status_mask;
 	if (_fpga_family == MACHXO3D_FAMILY)
@@ -485,7 +529,7 @@ bool Lattice::program_intFlash(ConfigBitstreamParser *_cbp)
 
 	/* bypass */
 	wr_rd(0xff, NULL, 0, NULL, 0);
-	/* ISC Enable 0xC6 followed by
+	/* ISC Enable 0xC6 (or 0x74 in transparent mode) followed by
 	 * 0x08 (Enable nVCM/Flash Normal mode */
 	printInfo("Enable configuration: ", false);
 	if (!EnableISC(0x08)) {
@@ -538,59 +582,52 @@ bool Lattice::program_intFlash(ConfigBitstreamParser *_cbp)
 	if (featuresRow != readFeaturesRow() || feabits != readFeabits())
 		eraseMode |= FLASH_ERASE_FEATURE;
 
-	/* ISC ERASE */
-	printInfo("Flash erase: ", false);
-	if (flashErase(eraseMode) == false) {
-		printError("FAIL");
-		return false;
-	} else {
-		printSuccess("DONE");
-	}
+	/* pages are first programmed in burst mode (see flashProg): on
+	 * failure flash is erased and programmed again with busy polling
+	 */
+	bool prog_done = false;
+	while (!prog_done) {
+		const bool burst = _burst_prog;
 
-	/* LSC_INIT_ADDRESS */
-	wr_rd(0x46, NULL, 0, NULL, 0);
-	_jtag->set_state(Jtag::RUN_TEST_IDLE);
-	_jtag->toggleClk(1000);
+		/* ISC ERASE */
+		printInfo("Flash erase: ", false);
+		if (flashErase(eraseMode) == false) {
+			printError("FAIL");
+			return false;
+		} else {
+			printSuccess("DONE");
+		}
 
-	/* flash CfgFlash */
-	if (false == flashProg(0, "data", cfg_data))
-		return false;
+		/* LSC_INIT_ADDRESS */
+		wr_rd(0x46, NULL, 0, NULL, 0);
+		wait_op(LATTICE_OP_CMD, true);
+
+		/* flash CfgFlash then EBR Init */
+		prog_done = flashProg(0, "data", cfg_data) &&
+			(ebr_data.empty() || flashProg(0, "EBR", ebr_data));
 
-	/* flash EBR Init */
-	if (ebr_data.size()) {
-		if (false == flashProg(0, "EBR", ebr_data))
+		if (prog_done && (eraseMode & FLASH_ERASE_UFM) != 0) {
+			setUFMAddress(ufm_start);
+
+			/* Same command to program CFG flash works for UFM. */
+			prog_done = flashProg(0, "UFM", ufm_data);
+		}
+
+		if (!prog_done && !burst)
 			return false;
 	}
+
 	/* verify write */
 	if (_verify) {
 		if (Verify(cfg_data) == false)
 			return false;
 	}
 
-	if ((eraseMode & FLASH_ERASE_UFM) != 0) {
-		/* LSC_WRITE_ADDRESS */
-		uint8_t tx[4] = {
-			static_cast<uint8_t>(ufm_start & 0xff),
-			static_cast<uint8_t>((ufm_start >> 8) & 0xff),
-			0,
-			0x40
-		};
-
-		wr_rd(LSC_WRITE_ADDRESS, tx, 4, NULL, 0);
-		_jtag->set_state(Jtag::RUN_TEST_IDLE);
-		_jtag->toggleClk(1000);
-
-		/* Same command to program CFG flash works for UFM. */
-		if (false == flashProg(0, "UFM", ufm_data))
-			return false;
-	}
-
 	/* missing usercode update */
 
 	/* LSC_INIT_ADDRESS */
 	wr_rd(0x46, NULL, 0, NULL, 0);
-	_jtag->set_state(Jtag::RUN_TEST_IDLE);
-	_jtag->toggleClk(1000);
+	wait_op(LATTICE_OP_CMD, true);
 
 	if ((eraseMode & FLASH_ERASE_FEATURE) != 0) {
 		/* write feature row */
@@ -633,6 +670,124 @@ bool Lattice::program_intFlash(ConfigBitstreamParser *_cbp)
 	return true;
 }
 
+void Lattice::setUFMAddress(uint16_t page)
+{
+	/* LSC_WRITE_ADDRESS */
+	uint8_t tx[4] = {
+		static_cast<uint8_t>(page & 0xff),
+		static_cast<uint8_t>((page >> 8) & 0xff),
+		0,
+		0x40
+	};
+
+	wr_rd(LSC_WRITE_ADDRESS, tx, 4, NULL, 0);
+	wait_op(LATTICE_OP_CMD, true);
+}
+
+bool Lattice::program_UFM(ConfigBitstreamParser *_cbp, uint32_t offset)
+{
+	vector<string> ufm_data;
+	uint32_t ufm_start = 0;
+
+	if (_file_extension == "jed") {
+		JedParser *_jed = reinterpret_cast<JedParser *>(_cbp);
+		for (size_t i = 0; i < _jed->nb_section(); i++) {
+			if (_jed->noteForSection(i) == "TAG DATA") {
+				ufm_data = _jed->data_for_section(i);
+				ufm_start = getUFMStartPageFromJEDEC(_jed, i);
+			}
+		}
+		if (ufm_data.empty()) {
+			printError("No UFM (TAG DATA) section in JEDEC file");
+			return false;
+		}
+	} else {
+		/* raw data: offset must be page aligned, last page is
+		 * completed with 0 (erased state)
+		 */
+		if ((offset % 16) != 0) {
+			printError("UFM offset must be a multiple of 16 (page size)");
+			return false;
+		}
+		ufm_start = offset / 16;
+		const uint8_t *data = _cbp->getData();
+		const uint32_t len = _cbp->getLength() / 8;
+		for (uint32_t pos = 0; pos < len; pos += 16) {
+			string page(16, '\0');
+			memcpy(&page[0], data + pos, std::min(16U, len - pos));
+			ufm_data.push_back(page);
+		}
+		if (ufm_data.empty()) {
+			printError("Empty UFM data");
+			return false;
+		}
+	}
+
+	const uint32_t ufm_pages = getUFMPageCount();
+	if (ufm_pages == 0) {
+		printError("No UFM in this part");
+		return false;
+	}
+	if (ufm_start >= ufm_pages || ufm_data.size() > ufm_pages - ufm_start) {
+		char mess[128];
+		snprintf(mess, sizeof(mess), "UFM data (pages %u to %u) out of "
+			"bounds: part has %u pages", ufm_start,
+			ufm_start + (uint32_t)ufm_data.size() - 1, ufm_pages);
+		printError(mess);
+		return false;
+	}
+
+	/* bypass */
+	wr_rd(0xff, NULL, 0, NULL, 0);
+	printInfo("Enable configuration: ", false);
+	if (!EnableISC(0x08)) {
+		printError("FAIL");
+		displayReadReg(readStatusReg());
+		return false;
+	} else {
+		printSuccess("DONE");
+	}
+
+	/* same retry policy as program_intFlash */
+	bool prog_done = false;
+	while (!prog_done) {
+		const bool burst = _burst_prog;
+
+		/* ISC ERASE: UFM sector only */
+		printInfo("UFM erase: ", false);
+		if (flashErase(FLASH_ERASE_UFM) == false) {
+			printError("FAIL");
+			return false;
+		} else {
+			printSuccess("DONE");
+		}
+
+		setUFMAddress(ufm_start);
+		prog_done = flashProg(0, "UFM", ufm_data);
+
+		if (!prog_done && !burst)
+			return false;
+	}
+
+	/* verify write */
+	if (_verify) {
+		if (Verify(ufm_data, false, 0, ufm_start) == false)
+			return false;
+	}
+
+	/* bypass */
+	wr_rd(0xff, NULL, 0, NULL, 0);
+	/* disable configuration mode */
+	printInfo("Disable configuration: ", false);
+	if (!DisableISC()) {
+		printError("FAIL");
+		return false;
+	} else {
+		printSuccess("DONE");
+	}
+	return true;
+}
+
 bool Lattice::prepare_flash_access()
 {
 	if (_skip_load_bridge) {
@@ -827,11 +982,17 @@ bool Lattice::program_flash(unsigned int offset, bool unprotect_flash)
 		if (_verbose)
 			_jed.displayHeader();
 
-		/* clear current SRAM content */
-		clearSRAM();
+		/* clear current SRAM content (in transparent mode
+		 * design keeps running until next refresh)
+		 */
+		if (!_transparent)
+			clearSRAM();
 
 		if (_fpga_family == MACHXO3D_FAMILY)
 			retval = program_intFlash_MachXO3D(_jed);
+		else if (_ufm_only)
+			retval = program_UFM(
+					reinterpret_cast<ConfigBitstreamParser*>(&_jed), 0);
 		else
 			retval = program_intFlash(
 					reinterpret_cast<ConfigBitstreamParser*>(&_jed));
@@ -839,6 +1000,11 @@ bool Lattice::program_flash(unsigned int offset, bool unprotect_flash)
 		 * and REFRESH no
 		 * TODO: same for machXO3x ?
 		 */
+		if (_transparent) {
+			if (retval)
+				transparent_done();
+			return retval;
+		}
 		if (_fpga_family == MACHXO2_FAMILY)
 			return retval;
 
@@ -848,6 +1014,30 @@ bool Lattice::program_flash(unsigned int offset, bool unprotect_flash)
 		clearSRAM();
 		program_pubkey_MachXO3D();
 	} else {
+		//  machxo2/3 + raw data to UFM
+		if (_ufm_only) {
+			try {
+				RawParser _raw(_filename, false);
+				_raw.parse();
+				/* clear current SRAM content */
+				if (!_transparent)
+					clearSRAM();
+				retval = program_UFM(
+						reinterpret_cast<ConfigBitstreamParser *>(&_raw),
+						offset);
+			} catch (std::exception &e) {
+				printError(e.what());
+				return false;
+			}
+			if (_transparent) {
+				if (retval)
+					transparent_done();
+				return retval;
+			}
+			if (_fpga_family == MACHXO2_FAMILY)
+				return retval;
+			return post_flash_access() && retval;
+		}
 		//  machox2 + bit
 		if (_file_extension == "bit" && _fpga_family == MACHXO2_FAMILY) {
 			try {
@@ -858,6 +1048,11 @@ bool Lattice::program_flash(unsigned int offset, bool unprotect_flash)
 			} catch (std::exception &e) {
 				return false;
 			}
+			if (_transparent) {
+				if (retval)
+					transparent_done();
+				return retval;
+			}
 			return post_flash_access() && retval;
 		}
 		/* !machXO and any file */
@@ -882,11 +1077,12 @@ void Lattice::program(unsigned int offset, bool unprotect_flash)
  */
 bool Lattice::EnableISC(uint8_t flash_mode)
 {
-	wr_rd(ISC_ENABLE, &flash_mode, 1, NULL, 0);
-
-	_jtag->set_state(Jtag::RUN_TEST_IDLE);
-	_jtag->toggleClk(1000);
-	if (!pollBusyFlag())
+	/* transparent mode is only used for flash access */
+	const bool transparent = _transparent &&
+		(flash_mode & ISC_ENABLE_FLASH_MODE) != 0;
+	wr_rd(transparent ? ISC_ENABLE_TRANSPARENT : ISC_ENABLE,
+		&flash_mode, 1, NULL, 0);
+	if (!wait_op(LATTICE_OP_ISC))
 		return false;
 	if (!checkStatus(REG_STATUS_ISC_EN, REG_STATUS_ISC_EN))
 		return false;
@@ -896,9 +1092,7 @@ bool Lattice::EnableISC(uint8_t flash_mode)
 bool Lattice::DisableISC()
 {
 	wr_rd(ISC_DISABLE, NULL, 0, NULL, 0);
-	_jtag->set_state(Jtag::RUN_TEST_IDLE);
-	_jtag->toggleClk(1000);
-	if (!pollBusyFlag())
+	if (!wait_op(LATTICE_OP_ISC))
 		return false;
 	if (!checkStatus(0, REG_STATUS_ISC_EN))
 		return false;
@@ -909,17 +1103,14 @@ bool Lattice::EnableCfgIf()
 {
 	uint8_t tx_buf = 0x08;
 	wr_rd(0x74, &tx_buf, 1, NULL, 0);
-	_jtag->set_state(Jtag::RUN_TEST_IDLE);
-	_jtag->toggleClk(1000);
-	return pollBusyFlag();
+	return wait_op(LATTICE_OP_ISC);
 }
 
 bool Lattice::DisableCfg()
 {
 	uint8_t tx_buf = 0, rx_buf;
 	wr_rd(0x26, &tx_buf, 1, &rx_buf, 1);
-	_jtag->set_state(Jtag::RUN_TEST_IDLE);
-	_jtag->toggleClk(1000);
+	wait_op(LATTICE_OP_CMD, true);
 	return true;
 }
 
@@ -949,8 +1140,7 @@ bool Lattice::checkID()
 	printf("check ID\n");
 	uint8_t tx[4] = { 0 };
 	wr_rd(0xE2, tx, 4, NULL, 0);
-	_jtag->set_state(Jtag::RUN_TEST_IDLE);
-	_jtag->toggleClk(1000);
+	wait_op(LATTICE_OP_CMD, true);
 
 	uint32_t reg = readStatusReg();
 	displayReadReg(reg);
@@ -960,8 +1150,7 @@ bool Lattice::checkID()
 	tx[1] = 0xd0;
 	tx[0] = 0x43;
 	wr_rd(0xE2, tx, 4, NULL, 0);
-	_jtag->set_state(Jtag::RUN_TEST_IDLE);
-	_jtag->toggleClk(1000);
+	wait_op(LATTICE_OP_CMD, true);
 	reg = readStatusReg();
 	displayReadReg(reg);
 	printf("%08x\n", reg);
@@ -994,9 +1183,8 @@ uint64_t Lattice::readStatusReg()
 	/* valgrind warn */
 	memset(tx, 0, 8);
 	memset(rx, 0, 8);
-	wr_rd(READ_STATUS_REGISTER, tx, reg_len, rx, reg_len);
-	_jtag->set_state(Jtag::RUN_TEST_IDLE);
-	_jtag->toggleClk(1000);
+	wr_rd(READ_STATUS_REGISTER, tx, reg_len, rx, reg_len, false, true);
+	wait_op(LATTICE_OP_CMD, true);
 	reg = (uint64_t) rx[7] << 56 | (uint64_t) rx[6] << 48 | (uint64_t) rx[5] << 40 | (uint64_t) rx[4] << 32 | rx[3] << 24 | rx[2] << 16 | rx[1] << 8 | rx[0];
 	return reg;
 }
@@ -1004,7 +1192,7 @@ uint64_t Lattice::readStatusReg()
 bool Lattice::wr_rd(uint8_t cmd,
 					uint8_t *tx, int tx_len,
 					uint8_t *rx, int rx_len,
-					bool verbose)
+					bool verbose, bool ir_cache)
 {
 	int kXferLen = rx_len;
 	if (tx_len > rx_len)
@@ -1019,7 +1207,7 @@ bool Lattice::wr_rd(uint8_t cmd,
 			xfer_tx[i] = tx[i];
 	}
 
-	_jtag->shiftIR(&cmd, NULL, 8, Jtag::PAUSE_IR);
+	_jtag->shiftIR(&cmd, NULL, 8, Jtag::PAUSE_IR, ir_cache);
 	if (rx || tx) {
 		_jtag->shiftDR(xfer_tx, (rx) ? xfer_rx : NULL, 8 * kXferLen,
 			Jtag::PAUSE_DR);
@@ -1199,23 +1387,120 @@ void Lattice::displayReadReg(uint64_t dev)
 
 bool Lattice::pollBusyFlag(bool verbose)
 {
-	uint8_t rx;
-	int timeout = 0;
-	do {
-		wr_rd(READ_BUSY_FLAG, NULL, 0, &rx, 1);
-		_jtag->set_state(Jtag::RUN_TEST_IDLE);
-		_jtag->toggleClk(1000);
-		if (verbose)
-			printf("pollBusyFlag :%02x\n", rx);
-		if (timeout == 100000000){
-			cerr << "timeout" << endl;
-			return false;
-		} else {
-			timeout++;
+	/* only used after feature row/key programming */
+	if (verbose)
+		printf("pollBusyFlag\n");
+	return wait_op(LATTICE_OP_PAGE_PROG);
+}
+
+void Lattice::wait_us(uint32_t us)
+{
+	/* short delay: TCK cycles (no round trip) */
+	if (us < 10000) {
+		uint64_t nb_clk = ((uint64_t)us * _jtag->getClkFreq()) / 1000000;
+		_jtag->toggleClk((nb_clk < 2) ? 2 : (int)nb_clk);
+	} else {
+		_jtag->flush();
+		usleep(us);
+	}
+}
+
+bool Lattice::wait_op(lattice_op_t op, bool no_poll)
+{
+	/* delay before first busy flag read (typical duration), datasheet
+	 * max duration (0: unknown, or depends on device size: busy flag
+	 * must be polled) and timeout, in us
+	 */
+	struct lattice_timing_t {
+		uint32_t delay_us;
+		uint32_t max_us;
+		uint32_t timeout_us;
+	};
+	static const lattice_timing_t timing_machxo[LATTICE_OP_NB] = {
+		{   200,  1000,  1000000},  // ISC
+		{   200,  1000,  1000000},  // ERASE_SRAM
+		{ 50000,     0, 60000000},  // ERASE_FLASH
+		{   200,  1000,  1000000},  // PAGE_PROG
+		{  1000,     0,  5000000},  // REFRESH
+		{   200,   200,  1000000},  // CMD
+	};
+	static const lattice_timing_t timing_ecp5[LATTICE_OP_NB] = {
+		{   200, 10000,  1000000},  // ISC
+		{  2000, 10000,  1000000},  // ERASE_SRAM
+		{  2000, 10000,  1000000},  // ERASE_FLASH (no internal flash)
+		{   200,  1000,  1000000},  // PAGE_PROG (feature row)
+		{  1000,     0,  5000000},  // REFRESH
+		{   200,   200,  1000000},  // CMD
+	};
+	/* FPGA-TN-02099: refresh duration "could be in seconds", busy
+	 * flag can't be cleared before: keep the former 5s wait until a
+	 * shorter delay is validated on hardware
+	 */
+	static const lattice_timing_t timing_nexus[LATTICE_OP_NB] = {
+		{    200, 10000,  1000000},  // ISC
+		{   2000, 10000,  1000000},  // ERASE_SRAM
+		{   2000, 10000,  1000000},  // ERASE_FLASH (no internal flash)
+		{    200,  1000,  1000000},  // PAGE_PROG (feature row)
+		{5000000,     0, 15000000},  // REFRESH
+		{    200,   200,  1000000},  // CMD
+	};
+
+	const lattice_timing_t *timing;
+	switch (_fpga_family) {
+		case ECP5_FAMILY:
+			timing = &timing_ecp5[op];
+			break;
+		case NEXUS_FAMILY:
+			timing = &timing_nexus[op];
+			break;
+		default:
+			timing = &timing_machxo[op];
+	}
+
+	lattice_op_stat_t &st = _op_stats[op];
+	auto begin = std::chrono::steady_clock::now();
+	bool ret = true;
+
+	_jtag->set_state(Jtag::RUN_TEST_IDLE);
+
+	if (no_poll && timing->max_us != 0) {
+		wait_us(timing->max_us);
+	} else {
+		wait_us(timing->delay_us);
+	}
+
+	/* datasheet max duration elapsed: no need to poll */
+	if ((!no_poll || timing->max_us == 0) &&
+			(timing->max_us == 0 || timing->delay_us < timing->max_us)) {
+		uint32_t backoff = (timing->delay_us < 100) ? 100 : timing->delay_us;
+		uint64_t waited = timing->delay_us;
+		uint8_t rx;
+		while (true) {
+			wr_rd(READ_BUSY_FLAG, NULL, 0, &rx, 1, false, true);
+			_jtag->set_state(Jtag::RUN_TEST_IDLE);
+			st.polls++;
+			if (rx == 0)
+				break;
+			if (waited >= timing->timeout_us) {
+				printError("timeout");
+				ret = false;
+				break;
+			}
+			wait_us(backoff);
+			waited += backoff;
+			if (backoff < 50000)
+				backoff *= 2;
 		}
-	} while (rx != 0);
+	}
 
-	return true;
+	uint64_t duration = std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - begin).count();
+	st.count++;
+	st.total_us += duration;
+	if (duration > st.max_us)
+		st.max_us = duration;
+
+	return ret;
 }
 
 bool Lattice::flashEraseAll()
@@ -1235,10 +1520,11 @@ bool Lattice::flashErase(uint32_t  mask)
 		uint8_t tx[1] = {(uint8_t)(mask & 0xff)};
 		wr_rd(FLASH_ERASE, tx, 1, NULL, 0);
 	}
-	_jtag->set_state(Jtag::RUN_TEST_IDLE);
-	_jtag->toggleClk(1000);
 
-	if (!pollBusyFlag())
+	/* ECP5/Nexus: SRAM only */
+	const bool sram = (mask == FLASH_ERASE_SRAM || _fpga_family == ECP5_FAMILY ||
+		_fpga_family == NEXUS_FAMILY);
+	if (!wait_op((sram) ? LATTICE_OP_ERASE_SRAM : LATTICE_OP_ERASE_FLASH))
 		return false;
 
 	if (!checkStatus(0, REG_STATUS_FAIL))
@@ -1254,19 +1540,33 @@ bool Lattice::flashProg(uint32_t start_addr, const string &name, vector<string>
 	for (uint32_t line = 0; line < data.size(); line++) {
 		wr_rd(PROG_CFG_FLASH, (uint8_t *)data[line].c_str(),
 				16, NULL, 0);
-		_jtag->set_state(Jtag::RUN_TEST_IDLE);
-		_jtag->toggleClk(1000);
+		if (!_burst_prog) {
+			progress.display(line);
+			if (wait_op(LATTICE_OP_PAGE_PROG) == false)
+				return false;
+			continue;
+		}
+
+		/* burst: no read between pages */
+		wait_op(LATTICE_OP_PAGE_PROG, true);
+		if ((line + 1) % LATTICE_PROG_BURST != 0 && line + 1 != data.size())
+			continue;
 		progress.display(line);
-		if (pollBusyFlag() == false)
+		if (!wait_op(LATTICE_OP_PAGE_PROG) || !checkStatus(0, REG_STATUS_FAIL)) {
+			progress.fail();
+			printWarn("burst programming failed: disabled");
+			_burst_prog = false;
 			return false;
+		}
 	}
 	progress.done();
 	return true;
 }
 
-bool Lattice::Verify(std::vector<std::string> data, bool unlock, uint32_t flash_area)
+bool Lattice::Verify(std::vector<std::string> data, bool unlock, uint32_t flash_area,
+		int ufm_page)
 {
-	uint8_t tx_buf[16], rx_buf[16];
+	uint8_t tx_buf[16];
 	if (unlock)
 		EnableISC(0x08);
 
@@ -1276,45 +1576,159 @@ bool Lattice::Verify(std::vector<std::string> data, bool unlock, uint32_t flash_
 			(uint8_t)((flash_area >> 16) & 0xff)
 		};
 		wr_rd(RESET_CFG_ADDR, tx, 2, NULL, 0);
+	} else if (ufm_page >= 0) {
+		setUFMAddress(ufm_page);
 	} else {
 		wr_rd(RESET_CFG_ADDR, NULL, 0, NULL, 0);
 	}
 
-	_jtag->set_state(Jtag::RUN_TEST_IDLE);
-	_jtag->toggleClk(1000);
+	wait_op(LATTICE_OP_CMD, true);
 
 	tx_buf[0] = REG_CFG_FLASH;
 	_jtag->shiftIR(tx_buf, NULL, 8, Jtag::PAUSE_IR);
 
 	memset(tx_buf, 0, 16);
-	bool failure = false;
-	ProgressBar progress("Verifying", data.size(), 50, _quiet);
-	for (size_t line = 0;  line< data.size(); line++) {
-		_jtag->set_state(Jtag::RUN_TEST_IDLE);
-		_jtag->toggleClk(2);
-		_jtag->shiftDR(tx_buf, rx_buf, 16*8, Jtag::PAUSE_DR);
-		for (size_t i = 0; i < data[line].size(); i++) {
-			if (rx_buf[i] != (unsigned char)data[line][i]) {
-				printf("%3zu %3zu %02x -> %02x\n", line, i,
-						rx_buf[i], (unsigned char)data[line][i]);
-				failure = true;
+	/* pages are read by bursts (one transfer) in a contiguous buffer.
+	 * A worker thread compares a burst while the next one is read (two
+	 * buffers). Mismatching pages are stored as ranges
+	 */
+	std::vector<uint8_t> rx_buf[2];
+	size_t burst_line[2] = {0, 0};
+	size_t burst_pages[2] = {0, 0};
+	bool full[2] = {false, false};
+	bool read_done = false;
+	std::mutex mtx;
+	std::condition_variable cv;
+	std::vector<std::pair<size_t, size_t>> mismatch;
+
+	auto compare_burst = [&](const uint8_t *buf, size_t line,
+			size_t nb_pages) {
+		for (size_t page = 0; page < nb_pages; page++) {
+			const string &ref = data[line + page];
+			const uint8_t *rx = buf + page * 16;
+			/* a page is 16 Bytes: longer reference can't match */
+			const size_t len = std::min(ref.size(), (size_t)16);
+			if (ref.size() <= 16 && memcmp(rx, ref.data(), len) == 0)
+				continue;
+			const size_t pos = line + page;
+			if (!mismatch.empty() && mismatch.back().second + 1 == pos)
+				mismatch.back().second = pos;
+			else
+				mismatch.push_back(std::make_pair(pos, pos));
+			if (_verbose) {
+				for (size_t i = 0; i < len; i++) {
+					if (rx[i] != (uint8_t)ref[i])
+						printf("%3zu %3zu %02x -> %02x\n", pos, i,
+							rx[i], (uint8_t)ref[i]);
+				}
 			}
 		}
-		if (failure) {
-			printf("Verify Failure\n");
-			break;
+	};
+
+	std::thread worker([&]() {
+		int idx = 0;
+		while (true) {
+			std::unique_lock<std::mutex> lck(mtx);
+			cv.wait(lck, [&]{ return full[idx] || read_done; });
+			if (!full[idx])
+				break;
+			lck.unlock();
+			compare_burst(rx_buf[idx].data(), burst_line[idx],
+				burst_pages[idx]);
+			lck.lock();
+			full[idx] = false;
+			cv.notify_all();
+			idx ^= 1;
 		}
-		progress.display(line);
+	});
+
+	/* worker must be stopped and joined on every exit path */
+	auto stop_worker = [&]() {
+		{
+			std::lock_guard<std::mutex> lck(mtx);
+			read_done = true;
+		}
+		cv.notify_all();
+		worker.join();
+	};
+
+	ProgressBar progress("Verifying", data.size(), 50, _quiet);
+	bool read_error = false;
+	int idx = 0;
+	try {
+		for (size_t line = 0; line < data.size();
+				line += LATTICE_VERIFY_BURST) {
+			const size_t nb_pages = std::min((size_t)LATTICE_VERIFY_BURST,
+				data.size() - line);
+			{
+				std::unique_lock<std::mutex> lck(mtx);
+				cv.wait(lck, [&]{ return !full[idx]; });
+			}
+			rx_buf[idx].resize(LATTICE_VERIFY_BURST * 16);
+			_jtag->batch_begin();
+			for (size_t page = 0; page < nb_pages; page++) {
+				_jtag->set_state(Jtag::RUN_TEST_IDLE);
+				_jtag->toggleClk(2);
+				_jtag->shiftDR(tx_buf, &rx_buf[idx][page * 16], 16*8,
+					Jtag::PAUSE_DR);
+			}
+			/* rx_buf content is stale: don't compare it */
+			if (_jtag->batch_execute() < 0) {
+				read_error = true;
+				break;
+			}
+			{
+				std::lock_guard<std::mutex> lck(mtx);
+				burst_line[idx] = line;
+				burst_pages[idx] = nb_pages;
+				full[idx] = true;
+			}
+			cv.notify_all();
+			idx ^= 1;
+			progress.display(line + nb_pages - 1);
+		}
+	} catch (const std::exception &e) {
+		/* transport failure: nothing more can be sent */
+		progress.fail();
+		stop_worker();
+		printError(std::string("Error: failed to read flash: ") + e.what());
+		return false;
+	} catch (...) {
+		progress.fail();
+		stop_worker();
+		throw;
 	}
+	stop_worker();
+
 	if (unlock)
 		DisableISC();
 
-	if (failure)
+	if (read_error) {
 		progress.fail();
-	else
+		printError("Error: failed to read flash");
+		return false;
+	}
+
+	if (mismatch.empty()) {
 		progress.done();
+		return true;
+	}
+
+	progress.fail();
+	size_t nb_bad = 0;
+	for (auto &m : mismatch)
+		nb_bad += m.second - m.first + 1;
+	printf("Verify Failure: %zu/%zu pages differ\n", nb_bad, data.size());
+	for (size_t i = 0; i < mismatch.size() && i < 16; i++) {
+		if (mismatch[i].first == mismatch[i].second)
+			printf("\tpage %zu\n", mismatch[i].first);
+		else
+			printf("\tpages %zu-%zu\n", mismatch[i].first, mismatch[i].second);
+	}
+	if (mismatch.size() > 16)
+		printf("\t... (%zu more ranges)\n", mismatch.size() - 16);
 
-	return !failure;
+	return false;
 }
 
 uint64_t Lattice::readFeaturesRow()
@@ -1333,8 +1747,7 @@ uint16_t Lattice::readFeabits()
 {
 	uint8_t rx_buf[2];
 	wr_rd(READ_FEABITS, NULL, 0, rx_buf, 2);
-	_jtag->set_state(Jtag::RUN_TEST_IDLE);
-	_jtag->toggleClk(1000);
+	wait_op(LATTICE_OP_CMD, true);
 
 	return rx_buf[0] | (((uint16_t)rx_buf[1]) << 8);
 }
@@ -1345,9 +1758,7 @@ bool Lattice::writeFeaturesRow(uint64_t features, bool verify)
 	for (int i=0; i < 8; i++)
 		tx_buf[i] = ((features >> (i*8)) & 0x00ff);
 	wr_rd(PROG_FEATURE_ROW, tx_buf, 8, NULL, 0);
-	_jtag->set_state(Jtag::RUN_TEST_IDLE);
-	_jtag->toggleClk(1000);
-	if (!pollBusyFlag())
+	if (!wait_op(LATTICE_OP_PAGE_PROG))
 		return false;
 	if (verify)
 		return (features == readFeaturesRow()) ? true : false;
@@ -1360,9 +1771,7 @@ bool Lattice::writeFeabits(uint16_t feabits, bool verify)
 							(uint8_t)(0x00ff & (feabits>>8))};
 
 	wr_rd(PROG_FEABITS, tx_buf, 2, NULL, 0);
-	_jtag->set_state(Jtag::RUN_TEST_IDLE);
-	_jtag->toggleClk(1000);
-	if (!pollBusyFlag())
+	if (!wait_op(LATTICE_OP_PAGE_PROG))
 		return false;
 	if (verify)
 		return (feabits == readFeabits()) ? true : false;
@@ -1372,21 +1781,41 @@ bool Lattice::writeFeabits(uint16_t feabits, bool verify)
 bool Lattice::writeProgramDone()
 {
 	wr_rd(PROG_DONE, NULL, 0, NULL, 0);
-	_jtag->set_state(Jtag::RUN_TEST_IDLE);
-	_jtag->toggleClk(1000);
-	if (!pollBusyFlag())
+	if (!wait_op(LATTICE_OP_PAGE_PROG))
 		return false;
 	if (!checkStatus(REG_STATUS_DONE, REG_STATUS_DONE))
 		return false;
 	return true;
 }
 
+void Lattice::reset()
+{
+	printInfo("Refresh: ", false);
+	if (!loadConfiguration()) {
+		printError("FAIL");
+		displayReadReg(readStatusReg());
+	} else {
+		printSuccess("DONE");
+	}
+
+	/* bypass */
+	wr_rd(0xff, NULL, 0, NULL, 0);
+	_jtag->go_test_logic_reset();
+}
+
+void Lattice::transparent_done()
+{
+	/* bypass: current design keeps running */
+	wr_rd(0xff, NULL, 0, NULL, 0);
+	_jtag->go_test_logic_reset();
+	printInfo("Flash written in background: new configuration is loaded "
+		"by next refresh (-r/--reset) or PROGRAMN/power cycle");
+}
+
 bool Lattice::loadConfiguration()
 {
 	wr_rd(REFRESH, NULL, 0, NULL, 0);
-	_jtag->set_state(Jtag::RUN_TEST_IDLE);
-	_jtag->toggleClk(1000);
-	if (!pollBusyFlag())
+	if (!wait_op(LATTICE_OP_REFRESH))
 		return false;
 	if (!checkStatus(REG_STATUS_DONE, REG_STATUS_DONE))
 		return false;
@@ -1429,33 +1858,62 @@ uint16_t Lattice::getUFMStartPageFromJEDEC(JedParser *_jed, int id)
 	}
 }
 
+uint16_t Lattice::getUFMPageCount()
+{
+	/* die size is given by IDCODE bits 14:12 (bit 15 is set for
+	 * the HC/C parts, U parts share the die of the next size).
+	 * Lattice TN-02155 (MachXO2) / TN1295 (MachXO3)
+	 */
+	switch ((_jtag->get_target_device_id() >> 12) & 0x07) {
+		case 1:
+			return 191;  // 640
+		case 2:
+			return 511;  // 1200, 640U, XO3 1300, XO3 640
+		case 3:
+			return 639;  // 2000, 1200U, XO3 2100
+		case 4:
+			return 767;  // 4000, 2000U, XO3 4300
+		case 5:
+			return 2046; // 7000, XO3 6900
+		case 6:
+			/* XO3 9400: larger UFM but JEDEC offsets are only known up to
+			 * the 6900 layout: keep the 6900 bound */
+			return 2046;
+		default:
+			return 0;    // 256: no UFM
+	}
+}
+
 /* ------------------ */
 /* SPI implementation */
 /* ------------------ */
 
 int Lattice::spi_put(uint8_t cmd, const uint8_t *tx, uint8_t *rx, uint32_t len)
 {
-	int xfer_len = len + 1;
-	uint8_t jtx[xfer_len];
-	uint8_t jrx[xfer_len];
-
-	jtx[0] = LatticeBitParser::reverseByte(cmd);
-
-	if (tx) {
-		for (uint32_t i=0; i < len; i++)
-			jtx[i+1] = LatticeBitParser::reverseByte(tx[i]);
+	uint32_t xfer_len = len + 1;
+	/* reused between calls: len may be large (flash read) */
+	if (_spi_tx.size() < xfer_len) {
+		_spi_tx.resize(xfer_len);
+		_spi_rx.resize(xfer_len);
 	}
+	uint8_t *jtx = _spi_tx.data();
+	uint8_t *jrx = _spi_rx.data();
+
+	jtx[0] = cmd;
+	if (tx)
+		memcpy(jtx + 1, tx, len);
+	else
+		memset(jtx + 1, 0, len);
 
 	/* send first already stored cmd,
 	 * in the same time store each byte
-	 * to next
+	 * to next (SPI is MSB first)
 	 */
-	_jtag->shiftDR(jtx, (rx == NULL)? NULL: jrx, 8*xfer_len);
+	_jtag->shiftDR(jtx, (rx == NULL)? NULL: jrx, 8*xfer_len,
+		Jtag::RUN_TEST_IDLE, true);
 
-	if (rx != NULL) {
-		for (uint32_t i=0; i < len; i++)
-			rx[i] = LatticeBitParser::reverseByte(jrx[i+1]);
-	}
+	if (rx != NULL)
+		memcpy(rx, jrx + 1, len);
 	return 0;
 }
 
@@ -1463,60 +1921,84 @@ int Lattice::spi_put(const uint8_t *tx, uint8_t *rx, uint32_t len)
 {
 	if (len == 0)
 		return 0;
-	uint8_t jtx[len];
-	uint8_t jrx[len];
 
-	memset(jrx, 0, len);
-
-	if (tx)
-		for (uint32_t i = 0; i < len; ++i)
-			jtx[i] = LatticeBitParser::reverseByte(tx[i]);
-	else
-		memset(jtx, 0, len);
+	if (!tx) {
+		if (_spi_tx.size() < len) {
+			_spi_tx.resize(len);
+			_spi_rx.resize(len);
+		}
+		memset(_spi_tx.data(), 0, len);
+		tx = _spi_tx.data();
+	}
 
 	/* send first already stored cmd,
 	 * in the same time store each byte
-	 * to next
+	 * to next (SPI is MSB first)
 	 */
-	_jtag->shiftDR(jtx, (rx) ? jrx : nullptr, 8 * len);
+	_jtag->shiftDR(tx, rx, 8 * len, Jtag::RUN_TEST_IDLE, true);
 
-	if (rx) {
-		for (uint32_t i = 0; i < len; ++i)
-			rx[i] = LatticeBitParser::reverseByte(jrx[i]);
-	}
 	return 0;
 }
 
 int Lattice::spi_wait(uint8_t cmd, uint8_t mask, uint8_t cond,
 		uint32_t timeout, bool verbose)
 {
-	uint8_t rx;
-	uint8_t dummy[2] = {0xff};
-	uint8_t tmp;
-	uint8_t tx = LatticeBitParser::reverseByte(cmd);
+	uint8_t rx[SPI_WAIT_BURST_MAX];
+	uint8_t dummy[SPI_WAIT_BURST_MAX];
+	uint8_t tmp = 0;
 	uint32_t count = 0;
+	uint32_t nb_samples = 0;
+	bool done = false;
+
+	/* status register is sent continuously as long as CS is low:
+	 * read a burst of samples per scan and search the first one
+	 * matching. Burst length starts with the previous delay observed
+	 * for this condition and grows while busy
+	 */
+	const uint16_t key = (mask << 8) | cond;
+	uint32_t burst = SPI_WAIT_BURST_MIN;
+	auto it = _spi_wait_burst.find(key);
+	if (it != _spi_wait_burst.end())
+		burst = it->second;
+
+	memset(dummy, 0xff, SPI_WAIT_BURST_MAX);
 
 	/* CS is low until state goes to EXIT1_IR
 	 * so manually move to state machine to stay is this
 	 * state as long as needed
 	 */
-	_jtag->shiftDR(&tx, NULL, 8, Jtag::SHIFT_DR);
+	_jtag->shiftDR(&cmd, NULL, 8, Jtag::SHIFT_DR, true);
 
 	do {
-		_jtag->shiftDR(dummy, &rx, 8, Jtag::SHIFT_DR);
-		tmp = (LatticeBitParser::reverseByte(rx));
+		_jtag->shiftDR(dummy, rx, 8 * burst, Jtag::SHIFT_DR, true);
+		for (uint32_t i = 0; i < burst; i++) {
+			tmp = rx[i];
+			nb_samples++;
+			if (verbose)
+				printf("%x %x %x %u\n", tmp, mask, cond, nb_samples);
+			if ((tmp & mask) == cond) {
+				done = true;
+				break;
+			}
+		}
+		/* timeout is a number of scans (as with one sample per scan) */
 		count++;
-		if (count == timeout){
-			printf("timeout: %x %x %u\n", tmp, rx, count);
+		if (!done && count == timeout) {
+			printf("timeout: %x %u\n", tmp, nb_samples);
 			break;
 		}
-
-		if (verbose) {
-			printf("%x %x %x %u\n", tmp, mask, cond, count);
-		}
-	} while ((tmp & mask) != cond);
-	_jtag->shiftDR(dummy, &rx, 8, Jtag::RUN_TEST_IDLE);
-	if (count == timeout) {
+		if (burst < SPI_WAIT_BURST_MAX)
+			burst *= 2;
+	} while (!done);
+	_jtag->shiftDR(dummy, rx, 8, Jtag::RUN_TEST_IDLE);
+
+	/* next wait: ready expected in one or two scans */
+	uint32_t next_burst = SPI_WAIT_BURST_MIN;
+	while (next_burst < SPI_WAIT_BURST_MAX && next_burst < nb_samples / 2)
+		next_burst *= 2;
+	_spi_wait_burst[key] = next_burst;
+
+	if (!done) {
 		printf("%x\n", tmp);
 		std::cout << "wait: Error" << std::endl;
 		return -ETIME;
@@ -1879,40 +2361,48 @@ bool Lattice::program_intFlash_MachXO3D(JedParser& _jed)
 			}
 		}
 
-		if (erase_op > 0) {
-			/* ISC ERASE */
-			printInfo("Flash erase: ", false);
-			if (flashErase(erase_op) == false) {
-				printError("FAIL");
-				return false;
+		/* burst programming failure: sector is erased and programmed
+		 * again with busy polling (only when this section erases it)
+		 */
+		bool prog_done = false;
+		while (!prog_done) {
+			const bool burst = _burst_prog;
+
+			if (erase_op > 0) {
+				/* ISC ERASE */
+				printInfo("Flash erase: ", false);
+				if (flashErase(erase_op) == false) {
+					printError("FAIL");
+					return false;
+				}
+				printSuccess("DONE");
 			}
-			printSuccess("DONE");
-		}
 
-		if (offset == 0) {
-			/* LSC_INIT_ADDRESS */
-			uint8_t tx[2] = {
-				(uint8_t)((prog_op >> 8) & 0xff),
-				(uint8_t)((prog_op >> 16) & 0xff)
-			};
-			printf("address (I): 0x%x 0x%x\n", tx[0], tx[1]);
-			wr_rd(RESET_CFG_ADDR, tx, 2, NULL, 0);
-		} else {
-			/* LSC_WRITE_ADDRESS */
-			uint8_t tx[3] = {
-				(uint8_t)(prog_op & 0xff),
-				(uint8_t)((prog_op >> 8) & 0xff),
-				(uint8_t)((prog_op >> 16) & 0x03)
-			};
-			printf("address (W): 0x%x 0x%x 0x%x\n", tx[0], tx[1], tx[2]);
-			wr_rd(LSC_WRITE_ADDRESS, tx, 3, NULL, 0);
-		}
-		_jtag->set_state(Jtag::RUN_TEST_IDLE);
-		_jtag->toggleClk(1000);
+			if (offset == 0) {
+				/* LSC_INIT_ADDRESS */
+				uint8_t tx[2] = {
+					(uint8_t)((prog_op >> 8) & 0xff),
+					(uint8_t)((prog_op >> 16) & 0xff)
+				};
+				printf("address (I): 0x%x 0x%x\n", tx[0], tx[1]);
+				wr_rd(RESET_CFG_ADDR, tx, 2, NULL, 0);
+			} else {
+				/* LSC_WRITE_ADDRESS */
+				uint8_t tx[3] = {
+					(uint8_t)(prog_op & 0xff),
+					(uint8_t)((prog_op >> 8) & 0xff),
+					(uint8_t)((prog_op >> 16) & 0x03)
+				};
+				printf("address (W): 0x%x 0x%x 0x%x\n", tx[0], tx[1], tx[2]);
+				wr_rd(LSC_WRITE_ADDRESS, tx, 3, NULL, 0);
+			}
+			wait_op(LATTICE_OP_CMD, true);
 
-		/* flash CfgFlash */
-		if (false == flashProg(0, area_name, data))
-			return false;
+			/* flash CfgFlash */
+			prog_done = flashProg(0, area_name, data);
+			if (!prog_done && (!burst || erase_op == 0))
+				return false;
+		}
 
 		/* verify write */
 		if (_verify) {
@@ -1937,8 +2427,7 @@ bool Lattice::program_intFlash_MachXO3D(JedParser& _jed)
 		};
 		wr_rd(RESET_CFG_ADDR, tx, 2, NULL, 0);
 	}
-	_jtag->set_state(Jtag::RUN_TEST_IDLE);
-	_jtag->toggleClk(1000);
+	wait_op(LATTICE_OP_CMD, true);
 
 	/* ISC program done 0x5E */
 	printInfo("Write program Done: ", false);
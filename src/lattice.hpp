@@ -8,6 +8,7 @@
 
 #include <stdint.h>
 #include <iostream>
+#include <map>
 #include <string>
 #include <vector>
 
@@ -22,18 +23,34 @@ class Lattice: public Device, SPIInterface {
 	public:
 		Lattice(Jtag *jtag, std::string filename, const std::string &file_type,
 			Device::prog_type_t prg_type, std::string flash_sector, bool verify,
-			int8_t verbose, bool skip_load_bridge, bool skip_reset);
+			int8_t verbose, bool skip_load_bridge, bool skip_reset,
+			bool transparent = false, bool ufm_only = false,
+			bool flash_diff = false,
+			const std::string &flash_manifest = "");
+		~Lattice();
 		uint32_t idCode() override;
 		int userCode();
-		void reset() override {}
+		/*!
+		 * \brief reload configuration from flash (LSC_REFRESH)
+		 */
+		void reset() override;
 		void program(unsigned int offset, bool unprotect_flash) override;
 		bool program_mem();
 		bool program_flash(unsigned int offset, bool unprotect_flash);
+		/*!
+		 * \brief compare flash content with data
+		 * \param[in] flash_area: MachXO3D sector
+		 * \param[in] ufm_page: MachXO2/3 UFM page where data starts
+		 *            (-1: configuration flash)
+		 */
 		bool Verify(std::vector<std::string> data, bool unlock = false,
-				uint32_t flash_area = 0);
+				uint32_t flash_area = 0, int ufm_page = -1);
 		bool dumpFlash(uint32_t base_addr, uint32_t len) override {
 			return SPIInterface::dump(base_addr, len);
 		}
+		bool verifyFlashManifest() override {
+			return SPIInterface::verify_manifest();
+		}
 
 		/*!
 		 * \brief protect SPI flash blocks
@@ -53,6 +70,12 @@ class Lattice: public Device, SPIInterface {
 		bool bulk_erase_flash() override {
 			return SPIInterface::bulk_erase_flash();
 		}
+		void begin_flash_session() override {
+			SPIInterface::begin_flash_session();
+		}
+		bool end_flash_session() override {
+			return SPIInterface::end_flash_session();
+		}
 
 		/* spi interface */
 		int spi_put(uint8_t cmd, const uint8_t *tx, uint8_t *rx,
@@ -72,13 +95,37 @@ class Lattice: public Device, SPIInterface {
 		};
 
 		lattice_family_t _fpga_family;
+		/* spi_wait: number of status bytes read per scan
+		 * for each mask/cond pair (adapted to the observed delay)
+		 */
+		std::map<uint16_t, uint32_t> _spi_wait_burst;
+		/* spi_put: command/answer buffers (only grow) */
+		std::vector<uint8_t> _spi_tx;
+		std::vector<uint8_t> _spi_rx;
 
 		int get_statusreg_size();
 
 		bool program_intFlash(ConfigBitstreamParser *_cbp);
 		bool program_extFlash(unsigned int offset, bool unprotect_flash);
+		/*!
+		 * \brief erase and program UFM sector only (MachXO2/3): CFG
+		 *        and feature row are kept
+		 * \param[in] _cbp: JEDEC (TAG DATA section) or raw data
+		 * \param[in] offset: raw data offset (bytes) in UFM
+		 */
+		bool program_UFM(ConfigBitstreamParser *_cbp, uint32_t offset);
+		/*!
+		 * \brief set flash address to UFM page (LSC_WRITE_ADDRESS)
+		 */
+		void setUFMAddress(uint16_t page);
+		/*!
+		 * \brief send instruction cmd then write tx / read rx (DR)
+		 * \param[in] ir_cache: skip IR scan when cmd is already loaded
+		 *            (only for read/poll instructions)
+		 */
 		bool wr_rd(uint8_t cmd, uint8_t *tx, int tx_len,
-				uint8_t *rx, int rx_len, bool verbose = false);
+				uint8_t *rx, int rx_len, bool verbose = false,
+				bool ir_cache = false);
 		/*!
 		 * \brief move device to SPI access
 		 */
@@ -93,15 +140,66 @@ class Lattice: public Device, SPIInterface {
 		 */
 		bool clearSRAM();
 		void unlock();
+		/*!
+		 * \brief enter configuration mode: offline (ISC_ENABLE) or,
+		 *        when _transparent, background (ISC_ENABLE_X): current
+		 *        design keeps running while flash is updated
+		 */
 		bool EnableISC(uint8_t flash_mode);
 		bool DisableISC();
 		bool EnableCfgIf();
 		bool DisableCfg();
 		bool pollBusyFlag(bool verbose = false);
+
+		/* timing model */
+		enum lattice_op_t {
+			LATTICE_OP_ISC = 0,     /*!< ISC enable/disable, device control */
+			LATTICE_OP_ERASE_SRAM,  /*!< SRAM erase */
+			LATTICE_OP_ERASE_FLASH, /*!< internal flash sector(s) erase */
+			LATTICE_OP_PAGE_PROG,   /*!< flash page, feature row, done bit */
+			LATTICE_OP_REFRESH,     /*!< LSC_REFRESH */
+			LATTICE_OP_CMD,         /*!< command without busy flag (address,
+			                         *   register read) */
+			LATTICE_OP_NB
+		};
+		/*!
+		 * \brief wait end of operation op (command already sent): TAP
+		 *        moves to RUN_TEST_IDLE and family delay is spent as
+		 *        TCK cycles. Busy flag is then polled with backoff,
+		 *        except when delay reaches datasheet max duration
+		 * \param[in] op: operation
+		 * \param[in] no_poll: spend datasheet max duration without
+		 *            reading busy flag (only when max is known)
+		 * \return false on timeout
+		 */
+		bool wait_op(lattice_op_t op, bool no_poll = false);
+		/*!
+		 * \brief spend us microseconds in current state (TCK cycles for
+		 *        short delays, host sleep otherwise)
+		 */
+		void wait_us(uint32_t us);
+		/* timing telemetry (per operation) */
+		struct lattice_op_stat_t {
+			uint32_t count;    /*!< number of wait_op */
+			uint32_t polls;    /*!< number of busy flag reads */
+			uint64_t total_us; /*!< cumulated duration */
+			uint64_t max_us;   /*!< longest duration */
+		};
+		lattice_op_stat_t _op_stats[LATTICE_OP_NB];
 		bool flashEraseAll();
 		bool flashErase(uint32_t mask);
+		/*!
+		 * \brief program pages (address already set). In burst mode
+		 *        pages are sent back to back with datasheet max program
+		 *        time between them, busy flag and status are only read
+		 *        at the end of each burst. On burst failure, burst mode
+		 *        is disabled (caller may erase and retry)
+		 */
 		bool flashProg(uint32_t start_addr, const std::string &name,
 				std::vector<std::string> data);
+		bool _burst_prog; /*!< flashProg burst mode (disabled on failure) */
+		bool _transparent; /*!< internal flash written in background mode */
+		bool _ufm_only; /*!< only UFM sector is written */
 		bool checkStatus(uint64_t val, uint64_t mask);
 		void displayReadReg(uint64_t dev);
 		uint64_t readStatusReg();
@@ -111,7 +209,17 @@ class Lattice: public Device, SPIInterface {
 		bool writeFeabits(uint16_t feabits, bool verify);
 		bool writeProgramDone();
 		bool loadConfiguration();
+		/*!
+		 * \brief end of a transparent mode write: device goes back
+		 *        to user mode without refresh
+		 */
+		void transparent_done();
 		uint16_t getUFMStartPageFromJEDEC(JedParser *_jed, int id);
+		/*!
+		 * \brief number of UFM pages (16 Bytes) of the MachXO2/3 target
+		 * \return 0 when the part has no (or an unknown) UFM
+		 */
+		uint16_t getUFMPageCount();
 
 		/* test */
 		bool checkID();
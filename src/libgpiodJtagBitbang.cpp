@@ -45,6 +45,7 @@ LibgpiodJtagBitbang::LibgpiodJtagBitbang(
 	std::string chip_dev = dev;
 	if (chip_dev.empty())
 		chip_dev = "/dev/gpiochip0";
+	_chip_dev = chip_dev;
 
 	display("libgpiod jtag bitbang driver, dev=%s, tck_pin=%d, tms_pin=%d, tdi_pin=%d, tdo_pin=%d\n",
 		chip_dev.c_str(), _tck_pin, _tms_pin, _tdi_pin, _tdo_pin);
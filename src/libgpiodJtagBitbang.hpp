@@ -38,6 +38,7 @@ class LibgpiodJtagBitbang : public JtagInterface {
 	int toggleClk(uint8_t tms, uint8_t tdo, uint32_t clk_len) override;
 
 	int get_buffer_size() override { return 0; }
+	std::string get_device_id() override { return _chip_dev; }
 	bool isFull() override { return false; }
 	int flush() override { return 0; }
 
@@ -63,6 +64,7 @@ class LibgpiodJtagBitbang : public JtagInterface {
 #endif
 
 	gpiod_chip *_chip;
+	std::string _chip_dev; /*!< gpiochip path */
 
 #ifdef GPIOD_APIV2
 	gpiod_request_config *_tck_req_cfg;
@@ -18,6 +18,7 @@
 #include "cxxopts.hpp"
 #include "device.hpp"
 #include "display.hpp"
+#include "flashManifest.hpp"
 #include "ftdispi.hpp"
 #include "ice40.hpp"
 #include "lattice.hpp"
@@ -84,6 +85,13 @@ struct arguments {
 	bool read_dna;
 	bool read_xadc;
 	string read_register;
+	uint32_t ftdi_buffer_size;
+	bool force_detect;
+	uint32_t max_chain_len;
+	bool transparent;
+	bool ufm_only;
+	bool flash_diff;
+	string flash_manifest;
 };
 
 int parse_opt(int argc, char **argv, struct arguments *args,
@@ -108,7 +116,14 @@ int main(int argc, char **argv)
 			/* xvc server */
 			false, 3721, "-",
 			"", false, {},  // mcufw conmcu, user_misc_dev_list
-			false, false, "" // read_dna, read_xadc, read_register
+			false, false, "", // read_dna, read_xadc, read_register
+			0,  // ftdi_buffer_size
+			false,  // force_detect
+			JTAG_MAX_DEVICES,  // max_chain_len
+			false,  // transparent
+			false,  // ufm_only
+			false,  // flash_diff
+			""  // flash_manifest
 	};
 	/* parse arguments */
 	try {
@@ -227,6 +242,7 @@ int main(int argc, char **argv)
 	// always set these
 	cable.config.index = args.cable_index;
 	cable.config.status_pin = args.status_pin;
+	cable.config.buffer_size = args.ftdi_buffer_size;
 
 	/* FLASH direct access */
 	if (args.spi || (board && board->mode == COMM_SPI)) {
@@ -287,6 +303,7 @@ int main(int argc, char **argv)
 			}
 
 			SPIFlash flash((SPIInterface *)spi, args.unprotect_flash, args.verbose);
+			flash.set_diff_prog(args.flash_diff);
 			flash.display_status_reg();
 
 			if (args.prg_type != Device::RD_FLASH &&
@@ -310,18 +327,35 @@ int main(int argc, char **argv)
 					printSuccess("DONE");
 				}
 
+				bool prog_ok = true;
 				try {
-					flash.erase_and_prog(args.offset, bit->getData(), bit->getLength()/8);
+					prog_ok = flash.erase_and_prog(args.offset, bit->getData(),
+							bit->getLength()/8) == 0;
 				} catch (std::exception &e) {
 					printError("FAIL: " + string(e.what()));
+					prog_ok = false;
 				}
 
-				if (args.verify)
-					flash.verify(args.offset, bit->getData(), bit->getLength() / 8);
+				if (args.verify && prog_ok)
+					prog_ok = flash.verify(args.offset, bit->getData(),
+							bit->getLength() / 8);
+
+				/* manifest only describes content really written */
+				if (!prog_ok)
+					spi_ret = EXIT_FAILURE;
+				else if (!args.flash_manifest.empty())
+					if (!FlashManifest::create(args.flash_manifest, args.offset,
+							bit->getData(), bit->getLength() / 8))
+						spi_ret = EXIT_FAILURE;
 
 				delete bit;
 			} else if (args.prg_type == Device::RD_FLASH) {
 				flash.dump(args.bit_file, args.offset, args.file_size);
+			} else if (!args.flash_manifest.empty()) {
+				FlashManifest manifest;
+				if (!manifest.load(args.flash_manifest) ||
+						!flash.verify(manifest))
+					spi_ret = EXIT_FAILURE;
 			}
 
 			if (args.unprotect_flash && args.bit_file.empty())
@@ -355,7 +389,7 @@ int main(int argc, char **argv)
 		jtag = new Jtag(cable, &pins_config, args.device, args.ftdi_serial,
 				args.freq, args.verbose, args.ip_adr, args.port,
 				args.invert_read_edge, args.probe_firmware,
-				args.user_misc_devs);
+				args.user_misc_devs, args.max_chain_len, args.force_detect);
 	} catch (std::exception &e) {
 		printError("JTAG init failed with: " + string(e.what()));
 		return EXIT_FAILURE;
@@ -394,6 +428,11 @@ int main(int argc, char **argv)
 				t,
 				args.user_misc_devs[t].name.c_str(),
 				args.user_misc_devs[t].irlength);
+			} else {
+				/* no IDCODE (BYPASS) or unknown: irlength detected */
+				printf("\tidcode   0x%x\n\ttype     %s\n\tirlength %d\n",
+				t, (t == 0) ? "BYPASS only" : "unknown",
+				jtag->get_irlength_list()[i]);
 			}
 		}
 		if (args.detect == true) {
@@ -452,7 +491,9 @@ int main(int argc, char **argv)
 	try {
 		if (fab == "lattice") {
 			fpga = new Lattice(jtag, args.bit_file, args.file_type,
-				args.prg_type, args.flash_sector, args.verify, args.verbose, args.skip_load_bridge, args.skip_reset);
+				args.prg_type, args.flash_sector, args.verify, args.verbose, args.skip_load_bridge, args.skip_reset,
+				args.transparent, args.ufm_only, args.flash_diff,
+				args.flash_manifest);
 		} else {
 			printError("Error: manufacturer " + fab + " not supported");
 			delete(jtag);
@@ -464,6 +505,11 @@ int main(int argc, char **argv)
 		return EXIT_FAILURE;
 	}
 
+	/* flash operations below share one flash access: device is
+	 * switched by the first one and reloaded when session is closed
+	 */
+	Device::FlashSession flash_session(fpga);
+
 	if ((!args.bit_file.empty() ||
 		 !args.secondary_bit_file.empty() ||
 		 !args.file_type.empty() || !args.mcufw.empty())
@@ -472,6 +518,8 @@ int main(int argc, char **argv)
 			fpga->program(args.offset, args.unprotect_flash);
 		} catch (std::exception &e) {
 			printError("Error: Failed to program FPGA: " + string(e.what()));
+			if (!flash_session.close())
+				printError("Error: device reload failed");
 			delete(fpga);
 			delete(jtag);
 			return EXIT_FAILURE;
@@ -510,11 +558,27 @@ int main(int argc, char **argv)
 		}
 	}
 
+	/* check SPI flash content against manifest */
+	int ret = EXIT_SUCCESS;
+	if (!args.flash_manifest.empty() && args.bit_file.empty() &&
+			args.prg_type != Device::RD_FLASH) {
+		if (!fpga->verifyFlashManifest())
+			ret = EXIT_FAILURE;
+	}
+
+	/* deferred device reload (REFRESH) after flash access */
+	if (!flash_session.close()) {
+		printError("Error: device reload failed");
+		ret = EXIT_FAILURE;
+	}
+
 	if (args.reset)
 		fpga->reset();
 
 	delete(fpga);
 	delete(jtag);
+
+	return ret;
 }
 
 // parse double from string in engineering notation
@@ -573,10 +637,28 @@ int parse_opt(int argc, char **argv, struct arguments *args,
 			("detect",      "detect FPGA",
 				cxxopts::value<bool>(args->detect))
 			("freq",        "jtag frequency (Hz)", cxxopts::value<string>(freqo))
+			("ftdi-buffer-size", "FTDI MPSSE host buffer size (Bytes, "
+				"USB max packet size to 1M, default 64K)",
+				cxxopts::value<uint32_t>(args->ftdi_buffer_size))
+			("force-detect", "ignore JTAG chain cache and scan chain",
+				cxxopts::value<bool>(args->force_detect))
+			("max-chain-length", "max number of devices in JTAG chain "
+				"(default: " + std::to_string(JTAG_MAX_DEVICES) + ")",
+				cxxopts::value<uint32_t>(args->max_chain_len))
+			("flash-diff", "write only SPI flash sectors with changes",
+				cxxopts::value<bool>(args->flash_diff))
+			("flash-manifest", "SPI flash manifest (SHA-256/CRC32C): "
+				"created when writing, checked without bitstream",
+				cxxopts::value<string>(args->flash_manifest))
 			("f,write-flash",
 				"write bitstream in flash (default: false)")
 			("r,reset",   "reset FPGA after operations",
 				cxxopts::value<bool>(args->reset))
+			("transparent", "write internal flash in background "
+				"(MachXO2/3): design keeps running until reset",
+				cxxopts::value<bool>(args->transparent))
+			("ufm-only", "write only UFM (MachXO2/3): JEDEC TAG DATA "
+				"or raw file at offset", cxxopts::value<bool>(args->ufm_only))
 			("unprotect-flash",   "Unprotect flash blocks",
 				cxxopts::value<bool>(args->unprotect_flash))
 			("v,verbose", "Produce verbose output", cxxopts::value<bool>(verbose))
@@ -632,6 +714,13 @@ int parse_opt(int argc, char **argv, struct arguments *args,
 			args->freq = static_cast<uint32_t>(freq);
 		}
 
+		if (args->max_chain_len == 0 ||
+				args->max_chain_len > JTAG_MAX_DEVICES_LIMIT) {
+			printError("Error: --max-chain-length must be between 1 and " +
+				std::to_string(JTAG_MAX_DEVICES_LIMIT));
+			throw std::exception();
+		}
+
 		if (result.count("pins")) {
 			if (pins.size() != 4) {
 				printError("Error: pin_config need 4 pins");
@@ -38,7 +38,8 @@ using namespace std;
 RemoteBitbang_client::RemoteBitbang_client(const std::string &ip_addr, int port,
 		int8_t verbose):
 	_xfer_buf(NULL), _num_bytes(0), _last_tms(TMS_BIT),
-	_last_tdi(0), _buffer_size(2048), _sock(0), _port(port)
+	_last_tdi(0), _buffer_size(2048), _num_reads(0), _batch(false),
+	_sock(0), _port(port), _device_id(ip_addr + "_" + std::to_string(port))
 {
 	(void) verbose;
 	/* create client to server */
@@ -86,9 +87,10 @@ int RemoteBitbang_client::writeTMS(const uint8_t *tms, uint32_t len,
 
 	uint8_t base_v = '0' + _last_tdi;
 	for (uint32_t pos = 0; pos < len; pos++) {
-		// buffer full -> write
-		if (_num_bytes == _buffer_size)
-			ll_write(NULL);
+		// buffer full -> write (writeTDI read requests may leave
+		// an odd number of bytes)
+		if (_num_bytes + 2 > _buffer_size)
+			ll_write();
 		_last_tms = (tms[pos >> 3] & (1 << (pos & 0x07))) ? TMS_BIT : 0;
 		_xfer_buf[_num_bytes++] = base_v + _last_tms;
 		_xfer_buf[_num_bytes++] = base_v + _last_tms + TCK_BIT;
@@ -106,10 +108,17 @@ int RemoteBitbang_client::writeTDI(const uint8_t *tx, uint8_t *rx, uint32_t len,
 	if (len == 0)  // nothing to do
 		return 0;
 
+	/* read requests are queued with the clock sequence and answers
+	 * are collected by ll_write when the buffer is sent: one round
+	 * trip per buffer instead of one per bit
+	 */
+	if (rx)
+		_rx_segs.push_back({rx, 0, len});
+
 	uint8_t base_v = '0' + _last_tms;
 	for (uint32_t pos = 0; pos < len; pos++) {
-		if (_num_bytes == _buffer_size)
-			ll_write(NULL);  // NULL because _num_bytes is always 0 when read
+		if (_num_bytes + 3 > _buffer_size)
+			ll_write();
 		_last_tdi = (tx[pos >> 3] & (1 << (pos & 0x07))) ? TDI_BIT : 0;
 		if (end && pos == len - 1) {
 			_last_tms = TMS_BIT;
@@ -118,15 +127,15 @@ int RemoteBitbang_client::writeTDI(const uint8_t *tx, uint8_t *rx, uint32_t len,
 		_xfer_buf[_num_bytes++] = base_v + _last_tdi;
 		_xfer_buf[_num_bytes++] = base_v + _last_tdi + TCK_BIT;
 		if (rx) {
-			uint8_t tdo;
-			ll_write(&tdo);
-			if (tdo == '1')
-				rx[pos >> 3] |= (1 << (pos & 0x07));
-			else
-				rx[pos >> 3] &= ~(1 << (pos & 0x07));
+			_xfer_buf[_num_bytes++] = 'R';
+			_num_reads++;
 		}
 	}
 
+	/* rx must be filled when returning (except in batch mode) */
+	if (rx && !_batch && !ll_write())
+		return -1;
+
 	return len;
 }
 
@@ -148,20 +157,26 @@ int RemoteBitbang_client::toggleClk(uint8_t tms, uint8_t tdi, uint32_t clk_len)
 		flush();
 
 	for (uint32_t len = 0; len < clk_len; len++) {
-		if (len == _num_bytes)
-			ll_write(NULL);
+		if (_num_bytes + 2 > _buffer_size)
+			ll_write();
 		_xfer_buf[_num_bytes++] = '0' + val;
 		_xfer_buf[_num_bytes++] = '0' + (val | TCK_BIT);
 	}
 
-	ll_write(NULL);
+	ll_write();
 
 	return clk_len;
 }
 
 int RemoteBitbang_client::flush()
 {
-	return ll_write(NULL);
+	return ll_write();
+}
+
+int RemoteBitbang_client::batch_execute()
+{
+	_batch = false;
+	return ll_write() ? 1 : -1;
 }
 
 int RemoteBitbang_client::setClkFreq(uint32_t clkHz)
@@ -217,7 +232,7 @@ ssize_t RemoteBitbang_client::xfer_pkt(uint8_t instr, uint8_t *rx)
 	return (rx) ? 1 : 0;
 }
 
-bool RemoteBitbang_client::ll_write(uint8_t *tdo)
+bool RemoteBitbang_client::ll_write()
 {
 	if (_num_bytes == 0)
 		return true;
@@ -230,13 +245,39 @@ bool RemoteBitbang_client::ll_write(uint8_t *tdo)
 	}
 	_num_bytes = 0;
 
-	// read only one char (if tdo is not null
-	if (tdo) {
-		if (xfer_pkt('R', tdo) < 0) {
+	if (_num_reads == 0)
+		return true;
+
+	// read answers (one char by 'R')
+	if (_tdo_buf.size() < _num_reads)
+		_tdo_buf.resize(_num_reads);
+	uint8_t *tdo = _tdo_buf.data();
+	uint32_t rd = 0;
+	while (rd < _num_reads) {
+		len = recv(_sock, tdo + rd, _num_reads - rd, 0);
+		if (len <= 0) {
 			printError("read request error");
+			_num_reads = 0;
+			_rx_segs.clear();
 			return false;
 		}
+		rd += len;
+	}
+
+	/* scatter answers: a segment may be completed by a later call */
+	uint32_t seg = 0;
+	for (uint32_t i = 0; i < _num_reads; i++) {
+		rx_seg_t &s = _rx_segs[seg];
+		if (tdo[i] == '1')
+			s.rx[s.offset >> 3] |= (1 << (s.offset & 0x07));
+		else
+			s.rx[s.offset >> 3] &= ~(1 << (s.offset & 0x07));
+		s.offset++;
+		if (--s.len == 0)
+			seg++;
 	}
+	_rx_segs.erase(_rx_segs.begin(), _rx_segs.begin() + seg);
+	_num_reads = 0;
 
 	return true;
 }
@@ -7,6 +7,7 @@
 #define SRC_REMOTEBITBANG_CLIENT_HPP_
 
 #include <string>
+#include <vector>
 
 #include "jtagInterface.hpp"
 
@@ -74,8 +75,12 @@ class RemoteBitbang_client: public JtagInterface {
 		 * unused
 		 */
 		int get_buffer_size() override { return _buffer_size;}
+		std::string get_device_id() override { return _device_id; }
 		bool isFull() override { return _buffer_size == _num_bytes;}
 
+		bool batch_begin() override { _batch = true; return true; }
+		int batch_execute() override;
+
 	private:
 		/*!
 		 * \brief create a TCP socket and connect to
@@ -95,11 +100,10 @@ class RemoteBitbang_client: public JtagInterface {
 
 		/*!
 		 * \brief lowlevel write: write internal buffer (ASCII format)
-		 *        and read one char when tdo is not NULL.
-		 * \param[out]: tdo: TDO read pointer (may be null)
+		 *        and read answers to all queued read ('R') requests.
 		 * \return false when failure
 		 */
-		bool ll_write(uint8_t *tdo);
+		bool ll_write();
 
 		uint8_t *_xfer_buf;    /*!< tx buffer */
 		uint32_t _num_bytes;   /*!< number of bits stored */
@@ -107,7 +111,17 @@ class RemoteBitbang_client: public JtagInterface {
 		uint32_t _last_tdi;    /*!< last known TDI state */
 
 		uint32_t _buffer_size; /*!< buffer max capacity */
+		struct rx_seg_t {
+			uint8_t *rx;     /*!< TDO destination */
+			uint32_t offset; /*!< next bit to fill */
+			uint32_t len;    /*!< remaining bits */
+		};
+		std::vector<rx_seg_t> _rx_segs; /*!< TDO destinations (in order) */
+		uint32_t _num_reads;   /*!< number of queued read requests */
+		std::vector<uint8_t> _tdo_buf; /*!< read requests answers */
+		bool _batch;           /*!< rx filled by batch_execute */
 		int _sock;             /*!< socket */
 		int _port;             /*!< target port */
+		std::string _device_id; /*!< ip and port (chain cache key) */
 };
 #endif  // SRC_REMOTEBITBANG_CLIENT_HPP_
@@ -3,15 +3,30 @@
  * Copyright (C) 2019 Gwenhael Goavec-Merou <gwenhael.goavec-merou@trabucayre.com>
  */
 
+#include <errno.h>
+#include <fcntl.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <condition_variable>
+#include <exception>
+#include <fstream>
+#include <iomanip>
 #include <map>
 #include <iostream>
-
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common.hpp"
 #include "progressBar.hpp"
 #include "display.hpp"
 #include "spiFlash.hpp"
@@ -23,6 +38,17 @@
 #define FLASH_RDSR     0x05
 #	define FLASH_RDSR_WIP	(0x01)
 #	define FLASH_RDSR_WEL	(0x02)
+/* typical erase durations (ms) when unknown for a flash */
+#define ERASE_4K_TYP_MS   50
+#define ERASE_32K_TYP_MS  150
+#define ERASE_64K_TYP_MS  250
+/* dump/verify: default and max chunk size (two chunks are allocated) */
+#define READ_CHUNK_SIZE   0x100000
+#define READ_CHUNK_MAX    0x1000000
+/* verify: max chunk size (as before overlapped verify) */
+#define VERIFY_CHUNK_MAX  0x10000
+/* verify: max number of mismatching ranges displayed */
+#define VERIFY_MAX_RANGES 16
 /* flash program */
 #define FLASH_PP       0x02
 /* flash program with 4-byte address */
@@ -48,6 +74,8 @@
 #define FLASH_ROTP     0x4B
 /* block (32Kb) erase */
 #define FLASH_BE32     0x52
+/* read SFDP: 3B addr + 8 dummy clk */
+#define FLASH_RDSFDP   0x5A
 /* block (32Kb) erase with 4-byte address */
 #define FLASH_4BE32    0x5C
 #define FLASH_POWER_UP 0xAB
@@ -83,10 +111,29 @@
 /* Global Block Protection unlock */
 #define FLASH_ULBPR 0x98
 
+/* true when len bytes are 0xFF (erased state): compared 64bits at a time */
+static bool is_blank(const uint8_t *data, int len)
+{
+	int i = 0;
+	for (; i + 8 <= len; i += 8) {
+		uint64_t word;
+		memcpy(&word, data + i, 8);
+		if (word != ~0ULL)
+			return false;
+	}
+	for (; i < len; i++) {
+		if (data[i] != 0xff)
+			return false;
+	}
+	return true;
+}
+
 SPIFlash::SPIFlash(SPIInterface *spi, bool unprotect, int8_t verbose):
 	_spi(spi), _verbose(verbose), _jedec_id(0),
-	_flash_model(NULL), _unprotect(unprotect)
+	_flash_model(NULL), _unprotect(unprotect), _diff_prog(false),
+	_has_sfdp(false)
 {
+	memset(&_sfdp, 0, sizeof(_sfdp));
 	reset();
 	power_up();
 	read_id();
@@ -179,51 +226,177 @@ int SPIFlash::block64_erase(int addr)
 	return 0;
 }
 
+SPIFlash::erase_caps_t SPIFlash::erase_caps()
+{
+	/* unknown chip: 64KB only */
+	erase_caps_t caps = {false, false, true, 0, 0, 0, 0, 0};
+	if (_flash_model) {
+		caps.has_4k = _flash_model->subsector_erase;
+		caps.has_32k = _flash_model->block32_erase;
+		caps.has_64k = _flash_model->sector_erase;
+		caps.t_4k = _flash_model->erase_4k_ms;
+		caps.t_32k = _flash_model->erase_32k_ms;
+		caps.t_64k = _flash_model->erase_64k_ms;
+		caps.t_chip = _flash_model->erase_chip_ms;
+		caps.chip_size = _flash_model->nr_sector * 0x10000;
+	} else if (_has_sfdp) {
+		/* only standard opcodes are used by erase functions */
+		caps.has_64k = false;
+		for (int i = 0; i < 4; i++) {
+			const uint32_t size = _sfdp.erase_size[i];
+			const uint8_t cmd = _sfdp.erase_cmd[i];
+			if (size == 0x1000 && cmd == FLASH_SE) {
+				caps.has_4k = true;
+				caps.t_4k = _sfdp.erase_ms[i];
+			} else if (size == 0x8000 && cmd == FLASH_BE32) {
+				caps.has_32k = true;
+				caps.t_32k = _sfdp.erase_ms[i];
+			} else if (size == 0x10000 && cmd == FLASH_BE64) {
+				caps.has_64k = true;
+				caps.t_64k = _sfdp.erase_ms[i];
+			}
+		}
+		/* no usable erase type: 64KB is assumed (as for an unknown
+		 * chip) unless SFDP gives another size for 0xD8 (erase
+		 * granularity not supported)
+		 */
+		if (!caps.has_4k && !caps.has_32k && !caps.has_64k) {
+			caps.has_64k = true;
+			for (int i = 0; i < 4; i++) {
+				if (_sfdp.erase_size[i] != 0 &&
+						_sfdp.erase_cmd[i] == FLASH_BE64)
+					caps.has_64k = false;
+			}
+		}
+		caps.t_chip = _sfdp.chip_erase_ms;
+		caps.chip_size = _sfdp.density;
+	}
+	return caps;
+}
+
+std::vector<SPIFlash::erase_op_t> SPIFlash::plan_erase(int base_addr,
+		int len)
+{
+	const erase_caps_t caps = erase_caps();
+	const bool has_4k = caps.has_4k, has_32k = caps.has_32k;
+	const bool has_64k = caps.has_64k;
+	const uint32_t t_4k = caps.t_4k ? caps.t_4k : ERASE_4K_TYP_MS;
+	const uint32_t t_32k = caps.t_32k ? caps.t_32k : ERASE_32K_TYP_MS;
+	const uint32_t t_64k = caps.t_64k ? caps.t_64k : ERASE_64K_TYP_MS;
+	const uint32_t chip_size = caps.chip_size;
+	/* chip erase is only considered with a known duration (database
+	 * or SFDP)
+	 */
+	const uint64_t t_chip = caps.t_chip;
+
+	std::vector<erase_op_t> plan;
+	if (len <= 0)
+		return plan;
+	if (!has_4k && !has_32k && !has_64k)
+		throw std::runtime_error("Error: no supported erase size "
+			"(4KB, 32KB or 64KB) for this flash");
+
+	/* range is extended to smallest erase size boundaries */
+	const uint32_t gran = has_4k ? 0x1000 : (has_32k ? 0x8000 : 0x10000);
+	const uint32_t start = base_addr & ~(gran - 1);
+	const uint32_t end = (base_addr + len + gran - 1) & ~(gran - 1);
+	const uint32_t nb = (end - start) / gran;
+
+	/* cost[i]: minimal duration to erase granules i to nb (never erasing
+	 * outside range), choice[i]: erase size used at granule i
+	 */
+	std::vector<uint64_t> cost(nb + 1, 0);
+	std::vector<uint32_t> choice(nb + 1, 0);
+	const uint64_t infinite = ~0ULL;
+	for (int i = (int)nb - 1; i >= 0; i--) {
+		const uint32_t addr = start + i * gran;
+		const uint32_t sizes[3] = {0x1000, 0x8000, 0x10000};
+		const bool has[3] = {has_4k, has_32k, has_64k};
+		const uint32_t dur[3] = {t_4k, t_32k, t_64k};
+		cost[i] = infinite;
+		for (int s = 0; s < 3; s++) {
+			const uint32_t nb_gran = sizes[s] / gran;
+			if (!has[s] || nb_gran == 0 || (addr & (sizes[s] - 1)) != 0 ||
+					i + nb_gran > nb || cost[i + nb_gran] == infinite)
+				continue;
+			if (cost[i + nb_gran] + dur[s] < cost[i]) {
+				cost[i] = cost[i + nb_gran] + dur[s];
+				choice[i] = sizes[s];
+			}
+		}
+		if (cost[i] == infinite)
+			throw std::runtime_error("no erase command for this area");
+	}
+
+	/* whole chip: use chip erase when faster */
+	if (t_chip != 0 && chip_size != 0 && start == 0 && end >= chip_size &&
+			t_chip < cost[0]) {
+		plan.push_back({0, 0});
+		return plan;
+	}
+	for (uint32_t i = 0; i < nb; i += choice[i] / gran)
+		plan.push_back({start + i * gran, choice[i]});
+	return plan;
+}
+
 int SPIFlash::sectors_erase(int base_addr, int size)
 {
+	std::vector<erase_op_t> plan;
+	try {
+		plan = plan_erase(base_addr, size);
+	} catch (std::exception &e) {
+		printError(e.what());
+		return -1;
+	}
+	if (plan.empty())
+		return 0;
 
-	// check if chip support sector and subsector erase
-	bool subsector_rdy = false, sector_rdy = true;
-	if (_flash_model) {
-		if (_flash_model->subsector_erase)
-			subsector_rdy = true;
-		if (!_flash_model->sector_erase)
-			sector_rdy = false;
+	if (plan.size() == 1 && plan[0].size == 0) {
+		printInfo("Erasing: chip erase (may take time) ", false);
+		if (bulk_erase() != 0) {
+			printError("FAIL");
+			return -1;
+		}
+		printSuccess("DONE");
+		return 0;
 	}
+
+	/* with a known typical duration, busy flag is only polled after
+	 * half of it
+	 */
+	const erase_caps_t caps = erase_caps();
 	int ret = 0;
-	int start_addr = base_addr;
-	/* compute end_addr to be multiple of 4Kb */
-	int end_addr = (base_addr + size + 0xfff) & ~0xfff;
-	if (!subsector_rdy)
-		end_addr = (base_addr + size + 0xffff) & ~0xffff;
-	ProgressBar progress("Erasing", end_addr, 50, _verbose < 0);
-	/* start with block size (64Kb) */
-	int step = 0x10000;
-	if (!sector_rdy)
-		step = 0x1000;
-
-	for (int addr = start_addr; addr < end_addr; addr += step) {
+	const uint32_t start_addr = plan.front().addr;
+	const uint32_t end_addr = plan.back().addr + plan.back().size;
+	ProgressBar progress("Erasing", end_addr - start_addr, 50, _verbose < 0);
+	for (const erase_op_t &op : plan) {
 		if (write_enable() == -1) {
 			ret = -1;
 			break;
 		}
 
-		/* if block erase + addr end out of end_addr -> use sector_erase (4Kb) */
-		if (!sector_rdy || (addr + step > end_addr && subsector_rdy)) {
-			step = 0x1000;
-			ret = sector_erase(addr);
+		uint32_t typ_ms;
+		if (op.size == 0x1000) {
+			ret = sector_erase(op.addr);
+			typ_ms = caps.t_4k;
+		} else if (op.size == 0x8000) {
+			ret = block32_erase(op.addr);
+			typ_ms = caps.t_32k;
 		} else {
-			ret = block64_erase(addr);
+			ret = block64_erase(op.addr);
+			typ_ms = caps.t_64k;
 		}
 
 		if (ret == -1) {
 			break;
 		}
+		if (typ_ms != 0)
+			usleep(typ_ms * 500);
 		if (_spi->spi_wait(FLASH_RDSR, FLASH_RDSR_WIP, 0x00, 100000, false) == -1) {
 			ret = -1;
 			break;
 		}
-		progress.display(addr);
+		progress.display(op.addr - start_addr);
 	}
 	if (ret == 0)
 		progress.done();
@@ -260,7 +433,21 @@ int SPIFlash::write_page(int addr, const uint8_t *data, int len)
 	if (write_enable() == -1)
 		return -1;
 
+	const auto start = std::chrono::steady_clock::now();
 	_spi->spi_put(write_cmd, tx, NULL, len+addr_len);
+
+	/* as for erase: with a known typical duration (SFDP), busy flag is
+	 * only polled after half of it. Time spent by the transfer itself
+	 * is deduced (no sleep when it already lasted longer)
+	 */
+	if (_has_sfdp && _sfdp.page_prog_us != 0) {
+		const auto elapsed = std::chrono::duration_cast<
+			std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - start).count();
+		const int64_t wait_us = _sfdp.page_prog_us / 2 - elapsed;
+		if (wait_us > 0)
+			usleep(wait_us);
+	}
 	return _spi->spi_wait(FLASH_RDSR, FLASH_RDSR_WIP, 0x00, 1000);
 }
 
@@ -278,8 +465,13 @@ int SPIFlash::read(int base_addr, uint8_t *data, int len)
 		read_cmd = FLASH_4READ;
 	}
 
-	uint8_t tx[len+addr_len];
-	uint8_t rx[len+addr_len];
+	/* no VLA: len may be large, buffers only grow */
+	if (_rd_tx.size() < len + addr_len) {
+		_rd_tx.resize(len + addr_len, 0);
+		_rd_rx.resize(len + addr_len);
+	}
+	uint8_t *tx = _rd_tx.data();
+	uint8_t *rx = _rd_rx.data();
 
 	if (read_cmd == FLASH_4READ)
 		tx[i++] = (uint8_t)(0xff & (base_addr >> 24));
@@ -295,19 +487,119 @@ int SPIFlash::read(int base_addr, uint8_t *data, int len)
 	return ret;
 }
 
-bool SPIFlash::dump(const std::string &filename, const int &base_addr,
-		const int &len, int rd_burst)
+bool SPIFlash::read_stream(int base_addr, int len, int rd_burst,
+		const std::string &mess,
+		const std::function<bool(const uint8_t *data, int offset,
+			int len)> &consumer)
 {
-	if (rd_burst == 0)
+	if (rd_burst <= 0)
+		rd_burst = READ_CHUNK_SIZE;
+	if (rd_burst > READ_CHUNK_MAX)
+		rd_burst = READ_CHUNK_MAX;
+	if (rd_burst > len)
 		rd_burst = len;
 
-	/* segfault with buffer > 1M */
-	if (rd_burst > 0x100000)
-		rd_burst = 0x100000;
+	/* double buffering: reader (this thread) fills a chunk while
+	 * worker thread consumes the other one
+	 */
+	std::vector<uint8_t> chunk[2];
+	int chunk_len[2] = {0, 0};
+	int chunk_offset[2] = {0, 0};
+	bool full[2] = {false, false};
+	bool read_done = false, consumer_error = false;
+	std::mutex mtx;
+	std::condition_variable cv;
+
+	std::thread worker([&]() {
+		int idx = 0;
+		while (true) {
+			std::unique_lock<std::mutex> lck(mtx);
+			cv.wait(lck, [&]{ return full[idx] || read_done; });
+			if (!full[idx])
+				break;
+			lck.unlock();
+			/* an exception can't leave the thread: abort the read */
+			bool ok;
+			try {
+				ok = consumer(chunk[idx].data(), chunk_offset[idx],
+						chunk_len[idx]);
+			} catch (const std::exception &e) {
+				printError(std::string("Error: ") + e.what());
+				ok = false;
+			} catch (...) {
+				ok = false;
+			}
+			lck.lock();
+			full[idx] = false;
+			if (!ok)
+				consumer_error = true;
+			cv.notify_all();
+			if (!ok)
+				break;
+			idx ^= 1;
+		}
+	});
+
+	/* worker must be stopped and joined on every exit path */
+	auto stop_worker = [&]() {
+		{
+			std::lock_guard<std::mutex> lck(mtx);
+			read_done = true;
+		}
+		cv.notify_all();
+		worker.join();
+	};
+
+	bool ret = true;
+	int idx = 0;
+	ProgressBar progress(mess, len, 50, false);
+	try {
+		for (int i = 0; i < len; i += rd_burst) {
+			const int size = std::min(rd_burst, len - i);
+			{
+				std::unique_lock<std::mutex> lck(mtx);
+				cv.wait(lck, [&]{ return !full[idx] || consumer_error; });
+				if (consumer_error)
+					break;
+			}
+			chunk[idx].resize(rd_burst);
+			if (0 != read(base_addr + i, chunk[idx].data(), size)) {
+				progress.fail();
+				printError("Failed to read flash");
+				ret = false;
+				break;
+			}
+			{
+				std::lock_guard<std::mutex> lck(mtx);
+				chunk_offset[idx] = i;
+				chunk_len[idx] = size;
+				full[idx] = true;
+			}
+			cv.notify_all();
+			idx ^= 1;
+			progress.display(i);
+		}
+	} catch (...) {
+		progress.fail();
+		stop_worker();
+		throw;
+	}
+
+	stop_worker();
 
-	std::string data;
-	data.resize(rd_burst);
+	if (consumer_error) {
+		progress.fail();
+		ret = false;
+	} else if (ret) {
+		progress.done();
+	}
+
+	return ret;
+}
 
+bool SPIFlash::dump(const std::string &filename, const int &base_addr,
+		const int &len, int rd_burst)
+{
 	printInfo("dump flash (May take time)");
 
 	printInfo("Open dump file ", false);
@@ -318,26 +610,37 @@ bool SPIFlash::dump(const std::string &filename, const int &base_addr,
 	} else {
 		printSuccess("DONE");
 	}
-
-	ProgressBar progress("Read flash ", len, 50, false);
-	for (int i = 0; i < len; i += rd_burst) {
-		if (rd_burst + i > len)
-			rd_burst = len - i;
-		if (0 != read(base_addr + i, (uint8_t*)&data[0], rd_burst)) {
-			progress.fail();
-			printError("Failed to read flash");
+#ifdef __linux__
+	/* reserve file space: avoid fragmentation and detect a full
+	 * disk before reading the flash
+	 */
+	if (len > 0) {
+		int err = posix_fallocate(fileno(fd), 0, len);
+		if (err == ENOSPC) {
+			printError("Not enough space for " + filename);
 			fclose(fd);
 			return false;
 		}
-		fwrite(data.c_str(), sizeof(uint8_t), rd_burst, fd);
-		progress.display(i);
+	}
+#endif
+
+	/* file is written by the worker thread */
+	bool write_error = false;
+	bool ret = read_stream(base_addr, len, rd_burst, "Read flash ",
+		[&](const uint8_t *data, int /*offset*/, int size) {
+			write_error = fwrite(data, sizeof(uint8_t), size, fd) !=
+				(size_t)size;
+			return !write_error;
+		});
+
+	if (fclose(fd) != 0)
+		write_error = true;
+	if (write_error) {
+		printError("Failed to write " + filename);
+		ret = false;
 	}
 
-	progress.done();
-
-	fclose(fd);
-
-	return true;
+	return ret;
 }
 
 int SPIFlash::erase_and_prog(int base_addr, const uint8_t *data, int len)
@@ -365,6 +668,12 @@ int SPIFlash::erase_and_prog(int base_addr, const uint8_t *data, int len)
 	uint8_t status = read_status_reg() & ~0x03;
 	if (_verbose > 0)
 		display_status_reg(status);
+	/* flash size from SFDP */
+	if (!_flash_model && _has_sfdp &&
+			(unsigned int)(base_addr + len) > _sfdp.density) {
+		printError("flash overflow");
+		return -1;
+	}
 	/* if known chip */
 	if (_flash_model) {
 		/* check if offset + len fit in flash */
@@ -430,23 +739,84 @@ int SPIFlash::erase_and_prog(int base_addr, const uint8_t *data, int len)
 		}
 	}
 
+	/* differential write: smallest erase unit supported by the flash */
+	const erase_caps_t caps = erase_caps();
+	if (!caps.has_4k && !caps.has_32k && !caps.has_64k) {
+		printError("Error: no supported erase size (4KB, 32KB or 64KB) "
+			"for this flash");
+		return -1;
+	}
+	const int unit = caps.has_4k ? 0x1000 : (caps.has_32k ? 0x8000 : 0x10000);
+	const int first_unit = base_addr & ~(unit - 1);
+	std::vector<bool> dirty;
+	if (_diff_prog) {
+		if (diff_units(base_addr, data, len, unit, dirty) == -1)
+			return -1;
+		int nb_dirty = std::count(dirty.begin(), dirty.end(), true);
+		int skipped = 0;
+		for (size_t i = 0; i < dirty.size(); i++) {
+			if (dirty[i])
+				continue;
+			const int u_start = std::max(first_unit + (int)i * unit, base_addr);
+			const int u_end = std::min(first_unit + ((int)i + 1) * unit,
+				base_addr + len);
+			skipped += u_end - u_start;
+		}
+		printInfo("Unchanged: " + std::to_string(dirty.size() - nb_dirty) +
+			"/" + std::to_string(dirty.size()) + " sectors, " +
+			std::to_string(skipped) + " Bytes skipped");
+	}
+
 	/* Now we can erase sector and write new data */
 	ProgressBar progress("Writing", len, 50, _verbose < 0);
-	if (sectors_erase(base_addr, len) == -1)
-		return -1;
+	if (!_diff_prog) {
+		if (sectors_erase(base_addr, len) == -1)
+			return -1;
+	} else {
+		/* erase each contiguous run of dirty units at once */
+		for (size_t i = 0; i < dirty.size(); ) {
+			if (!dirty[i]) {
+				i++;
+				continue;
+			}
+			size_t j = i;
+			while (j < dirty.size() && dirty[j])
+				j++;
+			if (sectors_erase(first_unit + i * unit, (j - i) * unit) == -1)
+				return -1;
+			i = j;
+		}
+	}
+
+	/* page size given by SFDP (256 otherwise) */
+	int page_size = 256;
+	if (_has_sfdp && _sfdp.page_size >= 16 && _sfdp.page_size <= 4096)
+		page_size = _sfdp.page_size;
 
+	/* area is erased: blank pages are already written */
 	const uint8_t *ptr = data;
-	int size = 0;
+	int size = 0, nb_blank = 0;
 	for (int addr = 0; addr < len; addr += size, ptr+=size) {
-		size = (addr + 256 > len)?(len-addr) : 256;
+		size = (addr + page_size > len)?(len-addr) : page_size;
 		if ((_jedec_id >> 8) == 0xbf258d) {
 			size = 1;
 		}
+		/* unchanged units: nothing to write */
+		if (_diff_prog &&
+				!dirty[(base_addr + addr - first_unit) / unit] &&
+				!dirty[(base_addr + addr + size - 1 - first_unit) / unit])
+			continue;
+		if (is_blank(ptr, size)) {
+			nb_blank++;
+			continue;
+		}
 		if (write_page(base_addr + addr, ptr, size) == -1)
 			return -1;
 		progress.display(addr);
 	}
 	progress.done();
+	if (nb_blank > 0)
+		printInfo("Blank pages skipped: " + std::to_string(nb_blank));
 
 	/* and if required: relock blocks */
 	if (must_relock) {
@@ -457,44 +827,129 @@ int SPIFlash::erase_and_prog(int base_addr, const uint8_t *data, int len)
 	return 0;
 }
 
-bool SPIFlash::verify(const int &base_addr, const uint8_t *data,
-		const int &len, int rd_burst)
+int SPIFlash::diff_units(int base_addr, const uint8_t *data, int len,
+		int unit, std::vector<bool> &dirty)
 {
-	if (rd_burst == 0) {
-		rd_burst = len;
-		if (rd_burst > 65536)
-			rd_burst = 65536;
-	}
+	const int first_unit = base_addr & ~(unit - 1);
+	const int end_addr = base_addr + len;
 
-	printInfo("Verifying write (May take time)");
+	/* only the part of each unit covered by data is read: large
+	 * bursts, compared by read_stream worker thread
+	 */
+	dirty.assign((end_addr - first_unit + unit - 1) / unit, false);
+	bool ret = read_stream(base_addr, len, 0, "Comparing ",
+		[&](const uint8_t *rd, int offset, int rd_len) {
+			int pos = 0;
+			while (pos < rd_len) {
+				const int addr = base_addr + offset + pos;
+				const int idx = (addr - first_unit) / unit;
+				const int size = std::min(rd_len - pos,
+					first_unit + (idx + 1) * unit - addr);
+				if (!dirty[idx] && memcmp(rd + pos, data + offset + pos,
+						size) != 0)
+					dirty[idx] = true;
+				pos += size;
+			}
+			return true;
+		});
 
-	std::string verify_data;
-	verify_data.resize(rd_burst);
+	return (ret) ? 0 : -1;
+}
 
-	ProgressBar progress("Read flash ", len, 50, false);
-	for (int i = 0; i < len; i += rd_burst) {
-		if (rd_burst + i > len)
-			rd_burst = len - i;
-		if (0 != read(base_addr + i, (uint8_t*)&verify_data[0], rd_burst)) {
-			progress.fail();
-			printError("Failed to read flash");
-			return false;
-		}
+void SPIFlash::display_mismatch(
+		const std::vector<std::pair<uint32_t, uint32_t>> &ranges)
+{
+	uint64_t total = 0;
+	for (auto &r : ranges)
+		total += r.second;
+	printError("Verification failed: " + std::to_string(total) +
+		" Byte in " + std::to_string(ranges.size()) + " range(s)");
+
+	char mess[64];
+	for (size_t i = 0; i < ranges.size() && i < VERIFY_MAX_RANGES; i++) {
+		snprintf(mess, sizeof(mess), "\t0x%08x - 0x%08x (%u Byte)",
+			ranges[i].first, ranges[i].first + ranges[i].second - 1,
+			ranges[i].second);
+		printError(mess);
+	}
+	if (ranges.size() > VERIFY_MAX_RANGES)
+		printError("\t... " + std::to_string(ranges.size() -
+			VERIFY_MAX_RANGES) + " more range(s)");
+}
 
+bool SPIFlash::verify(const int &base_addr, const uint8_t *data,
+		const int &len, int rd_burst)
+{
+	printInfo("Verifying write (May take time)");
 
-		for (int ii = 0; ii < rd_burst; ii++) {
-			if ((uint8_t)verify_data[ii] != data[i+ii]) {
-				progress.fail();
-				printError("Verification failed at " +
-						std::to_string(base_addr + i + ii));
-				return false;
+	/* consecutive mismatching Bytes are merged */
+	std::vector<std::pair<uint32_t, uint32_t>> ranges;
+	auto add_mismatch = [&](uint32_t addr) {
+		if (!ranges.empty() &&
+				ranges.back().first + ranges.back().second == addr)
+			ranges.back().second++;
+		else
+			ranges.push_back(std::make_pair(addr, 1));
+	};
+
+	if (rd_burst <= 0 || rd_burst > VERIFY_CHUNK_MAX)
+		rd_burst = VERIFY_CHUNK_MAX;
+	bool ret = read_stream(base_addr, len, rd_burst, "Read flash ",
+		[&](const uint8_t *rd, int offset, int size) {
+			const uint8_t *ref = data + offset;
+			/* memcmp by 256 Byte blocks: Bytes are only compared one
+			 * by one in mismatching blocks
+			 */
+			for (int i = 0; i < size; i += 256) {
+				const int blk = std::min(256, size - i);
+				if (memcmp(rd + i, ref + i, blk) == 0)
+					continue;
+				for (int ii = i; ii < i + blk; ii++) {
+					if (rd[ii] != ref[ii])
+						add_mismatch(base_addr + offset + ii);
+				}
 			}
-		}
-		progress.display(i);
+			return true;
+		});
+	if (!ret)
+		return false;
+
+	if (!ranges.empty()) {
+		display_mismatch(ranges);
+		return false;
 	}
 
-	progress.done();
+	return true;
+}
+
+bool SPIFlash::verify(const FlashManifest &manifest, int rd_burst)
+{
+	printInfo("Verifying flash against manifest (May take time)");
+
+	FlashManifest flash(manifest.base_addr(), manifest.length(),
+		manifest.block_size());
+	/* hashes are computed by the worker thread */
+	if (rd_burst <= 0 || rd_burst > VERIFY_CHUNK_MAX)
+		rd_burst = VERIFY_CHUNK_MAX;
+	bool ret = read_stream(manifest.base_addr(), manifest.length(), rd_burst,
+		"Read flash ", [&](const uint8_t *rd, int /*offset*/, int size) {
+			flash.update(rd, size);
+			return true;
+		});
+	if (!ret)
+		return false;
+	flash.finish();
+
+	std::vector<std::pair<uint32_t, uint32_t>> ranges;
+	if (!flash.compare(manifest, ranges)) {
+		if (ranges.empty())
+			printError("Verification failed: SHA-256 mismatch");
+		else
+			display_mismatch(ranges);
+		return false;
+	}
 
+	printSuccess("Flash content matches manifest");
 	return true;
 }
 
@@ -546,6 +1001,33 @@ void SPIFlash::read_id()
 
 		/* must be 0x20BA1810 ... */
 
+		/* no database entry: geometry and timings from SFDP */
+		if (read_sfdp()) {
+			const erase_caps_t caps = erase_caps();
+			char content[256];
+			snprintf(content, 256, "SFDP: %uKB, page %uB, erase%s%s%s, "
+					"%s address",
+					_sfdp.density / 1024, _sfdp.page_size,
+					caps.has_4k ? " 4K" : "", caps.has_32k ? " 32K" : "",
+					caps.has_64k ? " 64K" : "",
+					_sfdp.addr4 ? (_sfdp.addr3 ? "3/4-byte" : "4-byte") :
+					"3-byte");
+			printInfo(content);
+			if (_verbose > 0) {
+				for (int i = 0; i < 4; i++) {
+					if (_sfdp.erase_size[i] != 0)
+						printf("erase type %d      : %uB cmd %02x typ %ums\n",
+							i + 1, _sfdp.erase_size[i], _sfdp.erase_cmd[i],
+							_sfdp.erase_ms[i]);
+				}
+				printf("chip erase typ    : %ums\n", _sfdp.chip_erase_ms);
+				printf("page program typ  : %uus\n", _sfdp.page_prog_us);
+				printf("fast read         : 1-1-2 %02x 1-2-2 %02x 1-1-4 %02x "
+					"1-4-4 %02x\n", _sfdp.read_112, _sfdp.read_122,
+					_sfdp.read_114, _sfdp.read_144);
+			}
+		}
+
 		printf("Detail: \n");
 		printf("Jedec ID          : %02x\n", rx[0]);
 		printf("memory type       : %02x\n", rx[1]);
@@ -629,6 +1111,157 @@ void SPIFlash::display_status_reg(uint8_t reg)
 	}
 }
 
+/* SFDP field: typical duration count (+1) multiplied by unit */
+static uint32_t sfdp_duration(uint32_t count, uint32_t unit)
+{
+	return (count + 1) * unit;
+}
+
+static uint32_t sfdp_dword(const std::vector<uint8_t> &raw, uint32_t addr)
+{
+	return raw[addr] | (raw[addr + 1] << 8) | (raw[addr + 2] << 16) |
+		((uint32_t)raw[addr + 3] << 24);
+}
+
+bool SPIFlash::parse_sfdp(const std::vector<uint8_t> &raw, sfdp_t &sfdp)
+{
+	/* header: "SFDP" signature, revision, number of parameter
+	 * headers - 1, first parameter header is Basic Flash
+	 * Parameter Table (BFPT)
+	 */
+	if (raw.size() < 16 || sfdp_dword(raw, 0) != 0x50444653)
+		return false;
+	const uint32_t bfpt_len = raw[8 + 3];
+	const uint32_t bfpt = raw[8 + 4] | (raw[8 + 5] << 8) | (raw[8 + 6] << 16);
+	if (raw[8] != 0x00 || bfpt_len < 9 || bfpt + bfpt_len * 4 > raw.size())
+		return false;
+
+	std::vector<uint32_t> dw(bfpt_len);
+	for (uint32_t i = 0; i < bfpt_len; i++)
+		dw[i] = sfdp_dword(raw, bfpt + i * 4);
+
+	memset(&sfdp, 0, sizeof(sfdp));
+
+	/* DWORD 1: address bytes, fast read support */
+	const uint32_t addr_bytes = (dw[0] >> 17) & 0x03;
+	sfdp.addr3 = (addr_bytes == 0 || addr_bytes == 1);
+	sfdp.addr4 = (addr_bytes == 1 || addr_bytes == 2);
+	/* DWORD 2: density in bits (2^N when bit 31 is set) */
+	if (dw[1] & 0x80000000) {
+		const uint32_t n = dw[1] & 0x7fffffff;
+		if (n < 3 || n > 34)
+			return false;
+		sfdp.density = (uint32_t)(1ULL << (n - 3));
+	} else {
+		sfdp.density = (uint32_t)(((uint64_t)dw[1] + 1) / 8);
+	}
+	/* DWORD 3/4: fast read opcodes */
+	if (dw[0] & (1 << 21))
+		sfdp.read_144 = (dw[2] >> 8) & 0xff;
+	if (dw[0] & (1 << 22))
+		sfdp.read_114 = (dw[2] >> 24) & 0xff;
+	if (dw[0] & (1 << 16))
+		sfdp.read_112 = (dw[3] >> 8) & 0xff;
+	if (dw[0] & (1 << 20))
+		sfdp.read_122 = (dw[3] >> 24) & 0xff;
+	/* DWORD 8/9: erase types (size 2^N, opcode) */
+	for (int i = 0; i < 4; i++) {
+		const uint32_t val = (dw[7 + i / 2] >> ((i % 2) * 16)) & 0xffff;
+		if ((val & 0xff) == 0 || (val & 0xff) > 31)
+			continue;
+		sfdp.erase_size[i] = 1 << (val & 0xff);
+		sfdp.erase_cmd[i] = val >> 8;
+	}
+
+	sfdp.page_size = 256;
+	if (bfpt_len < 11)  /* JESD216 revision 0: no timings */
+		return true;
+
+	/* DWORD 10: erase types typical duration */
+	static const uint32_t erase_unit[4] = {1, 16, 128, 1000};
+	for (int i = 0; i < 4; i++) {
+		const uint32_t val = (dw[9] >> (4 + 7 * i)) & 0x7f;
+		if (sfdp.erase_size[i] != 0)
+			sfdp.erase_ms[i] = sfdp_duration(val & 0x1f, erase_unit[val >> 5]);
+	}
+	/* DWORD 11: page size, page program and chip erase typical duration */
+	sfdp.page_size = 1 << ((dw[10] >> 4) & 0x0f);
+	const uint32_t pp = (dw[10] >> 8) & 0x3f;
+	sfdp.page_prog_us = sfdp_duration(pp & 0x1f, (pp & 0x20) ? 64 : 8);
+	static const uint32_t chip_unit[4] = {16, 256, 4000, 64000};
+	const uint32_t ce = (dw[10] >> 24) & 0x7f;
+	sfdp.chip_erase_ms = sfdp_duration(ce & 0x1f, chip_unit[ce >> 5]);
+
+	return true;
+}
+
+bool SPIFlash::read_sfdp()
+{
+	char id[16];
+	snprintf(id, sizeof(id), "%06x", _jedec_id >> 8);
+	std::string cache_file = get_cache_dir();
+	if (!cache_file.empty())
+		cache_file += "/sfdp_" + std::string(id);
+
+	/* cached table: hex bytes, one line per 16 bytes */
+	std::vector<uint8_t> raw;
+	if (!cache_file.empty()) {
+		std::ifstream fd(cache_file);
+		std::string line;
+		while (fd.is_open() && std::getline(fd, line)) {
+			if (line.empty() || line[0] == '#')
+				continue;
+			std::istringstream iss(line);
+			unsigned int val;
+			while (iss >> std::hex >> val)
+				raw.push_back(val & 0xff);
+		}
+		if (!raw.empty() && parse_sfdp(raw, _sfdp)) {
+			_has_sfdp = true;
+			return true;
+		}
+		raw.clear();
+	}
+
+	/* header + first parameter header, then up to the BFPT end */
+	uint32_t len = 16;
+	for (int pass = 0; pass < 2; pass++) {
+		std::vector<uint8_t> tx(4 + len, 0), rx(4 + len, 0);
+		if (_spi->spi_put(FLASH_RDSFDP, tx.data(), rx.data(), 4 + len) != 0)
+			return false;
+		raw.assign(rx.begin() + 4, rx.end());
+		if (sfdp_dword(raw, 0) != 0x50444653)
+			return false;
+		const uint32_t bfpt = raw[12] | (raw[13] << 8) | (raw[14] << 16);
+		const uint32_t end = bfpt + raw[11] * 4;
+		if (end > 512)
+			return false;
+		if (end <= len)
+			break;
+		len = end;
+	}
+	if (!parse_sfdp(raw, _sfdp)) {
+		printWarn("invalid SFDP table");
+		return false;
+	}
+	_has_sfdp = true;
+
+	if (!cache_file.empty()) {
+		std::ofstream fd(cache_file, std::ios::trunc);
+		if (fd.is_open()) {
+			fd << "# openFPGALoader SFDP cache: flash " << id << std::endl;
+			for (size_t i = 0; i < raw.size(); i++) {
+				fd << std::hex << std::setw(2) << std::setfill('0')
+					<< (int)raw[i] << ((i % 16 == 15) ? "\n" : " ");
+			}
+			fd << std::endl;
+		} else if (_verbose > 0) {
+			printWarn("unable to write " + cache_file);
+		}
+	}
+	return true;
+}
+
 uint8_t SPIFlash::read_status_reg()
 {
 	uint8_t rx;
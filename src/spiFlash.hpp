@@ -6,15 +6,48 @@
 #ifndef SRC_SPIFLASH_HPP_
 #define SRC_SPIFLASH_HPP_
 
+#include <functional>
 #include <map>
 #include <string>
+#include <utility>
+#include <vector>
 
+#include "flashManifest.hpp"
 #include "spiInterface.hpp"
 #include "spiFlashdb.hpp"
 
+/*!
+ * \brief flash parameters from SFDP Basic Flash Parameter Table (JESD216)
+ */
+typedef struct {
+	uint32_t density;        /**< flash size (Bytes) */
+	uint32_t page_size;      /**< program page size (Bytes) */
+	bool addr3;              /**< 3-byte address support */
+	bool addr4;              /**< 4-byte address support */
+	uint32_t erase_size[4];  /**< erase types size (Bytes, 0: unused) */
+	uint8_t erase_cmd[4];    /**< erase types opcode */
+	uint32_t erase_ms[4];    /**< erase types typical duration (0: unknown) */
+	uint32_t chip_erase_ms;  /**< chip erase typical duration (0: unknown) */
+	uint32_t page_prog_us;   /**< page program typical duration (0: unknown) */
+	uint8_t read_112;        /**< 1-1-2 fast read opcode (0: unsupported) */
+	uint8_t read_122;        /**< 1-2-2 fast read opcode (0: unsupported) */
+	uint8_t read_114;        /**< 1-1-4 fast read opcode (0: unsupported) */
+	uint8_t read_144;        /**< 1-4-4 fast read opcode (0: unsupported) */
+} sfdp_t;
+
 class SPIFlash {
 	public:
 		SPIFlash(SPIInterface *spi, bool unprotect, int8_t verbose);
+		virtual ~SPIFlash() {}
+		/*!
+		 * \brief allows (or not) to unprotect memory before write
+		 */
+		void set_unprotect(bool unprotect) {_unprotect = unprotect;}
+		/*!
+		 * \brief enable differential write: erase_and_prog only
+		 *        erases and programs erase units differing from data
+		 */
+		void set_diff_prog(bool diff_prog) {_diff_prog = diff_prog;}
 		/* power */
 		virtual void power_up();
 		virtual void power_down();
@@ -60,29 +93,64 @@ class SPIFlash {
 		 */
 		int block64_erase(int addr);
 		/*!
-		 * \brief erase n sectors starting at base_addr
+		 * \brief erase area starting at base_addr, extended to erase
+		 *        size boundaries (see plan_erase)
 		 */
 		int sectors_erase(int base_addr, int len);
+		/*!
+		 * \brief one erase command
+		 */
+		struct erase_op_t {
+			uint32_t addr; /**< block address */
+			uint32_t size; /**< 4KB, 32KB, 64KB or 0 for chip erase */
+		};
+		/*!
+		 * \brief compute the 4KB/32KB/64KB/chip erase sequence with
+		 *        minimal typical duration covering base_addr to
+		 *        base_addr + len: area is extended to the smallest
+		 *        supported erase size but never more. Chip erase is
+		 *        only used when its duration is known and shorter
+		 * \return erase commands sequence (empty when len <= 0)
+		 */
+		std::vector<erase_op_t> plan_erase(int base_addr, int len);
 		/* write */
 		int write_page(int addr, const uint8_t *data, int len);
-		/* read */
+		/*!
+		 * \brief read len Byte starting at base_addr (command buffers
+		 *        are kept between calls)
+		 */
 		int read(int base_addr, uint8_t *data, int len);
 		/*!
 		 * \brief read len Byte starting at base_addr and store
-		 *        into filename
+		 *        into filename. Flash is read by chunks of rd_burst
+		 *        Byte in two buffers: a chunk is written to the file
+		 *        (writer thread) while the next one is read
 		 * \param[in] filename: file name
 		 * \param[in] base_addr: starting address in flash memory
 		 * \param[in] len: length (in Byte)
-		 * \param[in] rd_burst: size of packet to read
+		 * \param[in] rd_burst: size of packet to read (0: default,
+		 *            capped to bound memory usage)
 		 * \return false if read fails or filename can't be open, true otherwise
 		 */
 		bool dump(const std::string &filename, const int &base_addr,
 				const int &len, int rd_burst = 0);
 		/* combo flash + erase */
 		int erase_and_prog(int base_addr, const uint8_t *data, int len);
+		/*!
+		 * \brief read back erase units covering base_addr to
+		 *        base_addr + len and compare them with data
+		 * \param[in] unit: erase unit size (4K or 64K)
+		 * \param[out] dirty: one entry per unit, true when content
+		 *             differs
+		 * \return -1 if read fails, 0 otherwise
+		 */
+		int diff_units(int base_addr, const uint8_t *data, int len,
+				int unit, std::vector<bool> &dirty);
 		/*!
 		 * \brief check if area base_addr to base_addr + len match
-		 *        data content
+		 *        data content. Comparison is done by a worker thread
+		 *        while next packet is read, all mismatching ranges
+		 *        are reported
 		 * \param[in] base_addr: base address to read
 		 * \param[in] data: theoretical area content
 		 * \param[in] len: length (in Byte) to area and data
@@ -91,16 +159,52 @@ class SPIFlash {
 		 */
 		bool verify(const int &base_addr, const uint8_t *data,
 				const int &len, int rd_burst = 0);
+		/*!
+		 * \brief check if area described by manifest match its
+		 *        hashes (original content not required)
+		 * \param[in] manifest: reference (area and hashes)
+		 * \param[in] rd_burst: size of packet to read
+		 * \return false if read fails or content didn't match, true otherwise
+		 */
+		bool verify(const FlashManifest &manifest, int rd_burst = 0);
 		/* return status register value */
 		uint8_t read_status_reg();
 		/* display/info */
 		void display_status_reg(uint8_t reg);
 		void display_status_reg() {display_status_reg(read_status_reg());}
 		virtual void read_id();
+		/*!
+		 * \brief read SFDP table (or its cached copy) and fill _sfdp
+		 * \return false when flash has no (valid) SFDP
+		 */
+		bool read_sfdp();
+		/*!
+		 * \brief parse SFDP area (from address 0 to the end of
+		 *        Basic Flash Parameter Table)
+		 * \param[in] raw: SFDP area
+		 * \param[out] sfdp: flash parameters
+		 * \return false if raw is not a valid SFDP area
+		 */
+		static bool parse_sfdp(const std::vector<uint8_t> &raw, sfdp_t &sfdp);
 		uint16_t readNonVolatileCfgReg();
 		uint16_t readVolatileCfgReg();
 
 	protected:
+		/*!
+		 * \brief erase capabilities (flash database, SFDP or unknown)
+		 */
+		struct erase_caps_t {
+			bool has_4k;        /**< 4KB erase */
+			bool has_32k;       /**< 32KB erase */
+			bool has_64k;       /**< 64KB erase */
+			uint32_t t_4k;      /**< 4KB erase typical duration (ms, 0: unknown) */
+			uint32_t t_32k;     /**< 32KB erase typical duration */
+			uint32_t t_64k;     /**< 64KB erase typical duration */
+			uint32_t t_chip;    /**< chip erase typical duration (0: unknown) */
+			uint32_t chip_size; /**< flash size (Bytes, 0: unknown) */
+		};
+		erase_caps_t erase_caps();
+
 		/*!
 		 * \brief retrieve TB (Top/Bottom) bit from one register
 		 *        (depends on flash)
@@ -129,12 +233,34 @@ class SPIFlash {
 		 * \return bp code (based on chip bp[x] position)
 		 */
 		uint8_t len_to_bp(uint32_t len);
+		/*!
+		 * \brief read base_addr to base_addr + len by packets of rd_burst
+		 *        Byte (two buffers). consumer is called by a worker thread
+		 *        with each packet while the next one is read
+		 * \param[in] consumer: receive packet, its offset (from
+		 *            base_addr) and length. false aborts the read
+		 * \return false if read or consumer fails
+		 */
+		bool read_stream(int base_addr, int len, int rd_burst,
+				const std::string &mess,
+				const std::function<bool(const uint8_t *data, int offset,
+					int len)> &consumer);
+		/*!
+		 * \brief display mismatching ranges (address, length)
+		 */
+		void display_mismatch(
+				const std::vector<std::pair<uint32_t, uint32_t>> &ranges);
 
 		SPIInterface *_spi;
 		int8_t _verbose;
 		uint32_t _jedec_id; /**< CHIP ID */
 		flash_t *_flash_model; /**< detect flash model */
 		bool _unprotect; /**< allows to unprotect memory before write */
+		bool _diff_prog; /**< only write erase units with changes */
+		bool _has_sfdp; /**< _sfdp filled (unknown chip only) */
+		sfdp_t _sfdp; /**< SFDP parameters */
+		std::vector<uint8_t> _rd_tx; /**< read command buffer */
+		std::vector<uint8_t> _rd_rx; /**< read answer buffer */
 };
 
 #endif  // SRC_SPIFLASH_HPP_
@@ -23,7 +23,6 @@ typedef struct {
 	std::string model;        /**< chip name */
 	uint32_t nr_sector;       /**< number of sectors */
 	bool sector_erase;        /**< 64KB erase support */
-	/* missing 32KB erase */
 	bool subsector_erase;     /**< 4KB erase support */
 	bool has_extended;
 	bool tb_otp;              /**< TOP/BOTTOM One Time Programming */
@@ -31,6 +30,12 @@ typedef struct {
 	tb_loc_t tb_register;     /**< TOP/BOTTOM location (register) */
 	uint8_t bp_len;           /**< BPx length */
 	uint8_t bp_offset[4];     /**< BP[0:3] bit offset */
+	bool block32_erase;       /**< 32KB erase support */
+	/* typical erase durations (ms), 0: unknown (generic value used) */
+	uint16_t erase_4k_ms;     /**< 4KB erase */
+	uint16_t erase_32k_ms;    /**< 32KB erase */
+	uint16_t erase_64k_ms;    /**< 64KB erase */
+	uint32_t erase_chip_ms;   /**< chip erase */
 } flash_t;
 
 static std::map <uint32_t, flash_t> flash_list = {
@@ -45,7 +50,12 @@ static std::map <uint32_t, flash_t> flash_list = {
 		.tb_offset = (1 << 5),
 		.tb_register = CONFR,
 		.bp_len = 3,
-		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), 0}}
+		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), 0},
+		.block32_erase = false,
+		.erase_4k_ms = 0,
+		.erase_32k_ms = 0,
+		.erase_64k_ms = 0,
+		.erase_chip_ms = 0}
 	},
 	{0x010219, {
 		.manufacturer = "spansion",
@@ -58,7 +68,12 @@ static std::map <uint32_t, flash_t> flash_list = {
 		.tb_offset = (1 << 5),
 		.tb_register = CONFR,
 		.bp_len = 3,
-		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), 0}}
+		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), 0},
+		.block32_erase = false,
+		.erase_4k_ms = 0,
+		.erase_32k_ms = 0,
+		.erase_64k_ms = 0,
+		.erase_chip_ms = 0}
 	},
 	{0x010220, {
 		.manufacturer = "spansion",
@@ -71,7 +86,12 @@ static std::map <uint32_t, flash_t> flash_list = {
 		.tb_offset = (1 << 5),
 		.tb_register = CONFR,
 		.bp_len = 3,
-		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), 0}}
+		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), 0},
+		.block32_erase = false,
+		.erase_4k_ms = 0,
+		.erase_32k_ms = 0,
+		.erase_64k_ms = 0,
+		.erase_chip_ms = 0}
 	},
 	{0x012018, {
 		.manufacturer = "spansion",
@@ -84,7 +104,12 @@ static std::map <uint32_t, flash_t> flash_list = {
 		.tb_offset = (1 << 5),
 		.tb_register = CONFR,
 		.bp_len = 3,
-		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), 0}}
+		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), 0},
+		.block32_erase = false,
+		.erase_4k_ms = 0,
+		.erase_32k_ms = 0,
+		.erase_64k_ms = 0,
+		.erase_chip_ms = 0}
 	},
 	{0x016018, {
 		.manufacturer = "spansion",
@@ -97,7 +122,12 @@ static std::map <uint32_t, flash_t> flash_list = {
 		.tb_offset = (1 << 6),
 		.tb_register = STATR,
 		.bp_len = 4,
-		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), (1 << 5)}}
+		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), (1 << 5)},
+		.block32_erase = true,
+		.erase_4k_ms = 0,
+		.erase_32k_ms = 0,
+		.erase_64k_ms = 0,
+		.erase_chip_ms = 0}
 	},
 	{0x016019, {
 		.manufacturer = "spansion",
@@ -110,7 +140,12 @@ static std::map <uint32_t, flash_t> flash_list = {
 		.tb_offset = (1 << 6),
 		.tb_register = STATR,
 		.bp_len = 4,
-		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), (1 << 5)}}
+		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), (1 << 5)},
+		.block32_erase = true,
+		.erase_4k_ms = 0,
+		.erase_32k_ms = 0,
+		.erase_64k_ms = 0,
+		.erase_chip_ms = 0}
 	},
 	/* https://datasheet.octopart.com/M25P16-VME6G-STMicroelectronics-datasheet-7623188.pdf */
 	{0x00202015, {
@@ -124,7 +159,12 @@ static std::map <uint32_t, flash_t> flash_list = {
 		.tb_offset = 0, // unused
 		.tb_register = STATR,
 		.bp_len = 3,
-		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), 0}}
+		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), 0},
+		.block32_erase = false,
+		.erase_4k_ms = 0,
+		.erase_32k_ms = 0,
+		.erase_64k_ms = 0,
+		.erase_chip_ms = 0}
 	},
 	/* https://pdf1.alldatasheet.com/datasheet-pdf/download/104949/STMICROELECTRONICS/M25P32.html */
 	{0x00202016, {
@@ -138,7 +178,12 @@ static std::map <uint32_t, flash_t> flash_list = {
 		.tb_offset = 0, // unused
 		.tb_register = STATR,
 		.bp_len = 3,
-		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), 0}}
+		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), 0},
+		.block32_erase = false,
+		.erase_4k_ms = 0,
+		.erase_32k_ms = 0,
+		.erase_64k_ms = 0,
+		.erase_chip_ms = 0}
 	},
 	{0x0020ba16, {
 		.manufacturer = "micron",
@@ -151,7 +196,12 @@ static std::map <uint32_t, flash_t> flash_list = {
 		.tb_offset = (1 << 5),
 		.tb_register = STATR,
 		.bp_len = 3,
-		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), 0}}
+		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), 0},
+		.block32_erase = false,
+		.erase_4k_ms = 0,
+		.erase_32k_ms = 0,
+		.erase_64k_ms = 0,
+		.erase_chip_ms = 0}
 	},
 	{0x0020ba17, {
 		.manufacturer = "micron",
@@ -164,7 +214,12 @@ static std::map <uint32_t, flash_t> flash_list = {
 		.tb_offset = (1 << 5),
 		.tb_register = STATR,
 		.bp_len = 4,
-		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), (1 << 6)}}
+		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), (1 << 6)},
+		.block32_erase = false,
+		.erase_4k_ms = 0,
+		.erase_32k_ms = 0,
+		.erase_64k_ms = 0,
+		.erase_chip_ms = 0}
 	},
   {0x0020bb18, {
 		/* https://www.micron.com/-/media/client/global/documents/products/data-sheet/nor-flash/serial-nor/n25q/n25q_128mb_1_8v_65nm.pdf */
@@ -180,7 +235,12 @@ static std::map <uint32_t, flash_t> flash_list = {
 		.tb_offset = (1 << 5),
 		.tb_register = STATR,
 		.bp_len = 4,
-		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), (1 << 6)}}
+		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), (1 << 6)},
+		.block32_erase = false,
+		.erase_4k_ms = 0,
+		.erase_32k_ms = 0,
+		.erase_64k_ms = 0,
+		.erase_chip_ms = 0}
 	},
 	{0x0020ba18, {
 		/* https://media-www.micron.com/-/media/client/global/documents/products/data-sheet/nor-flash/serial-nor/n25q/n25q_128mb_3v_65nm.pdf */
@@ -194,7 +254,12 @@ static std::map <uint32_t, flash_t> flash_list = {
 		.tb_offset = (1 << 5),
 		.tb_register = STATR,
 		.bp_len = 4,
-		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), (1 << 6)}}
+		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), (1 << 6)},
+		.block32_erase = false,
+		.erase_4k_ms = 0,
+		.erase_32k_ms = 0,
+		.erase_64k_ms = 0,
+		.erase_chip_ms = 0}
 	},
 	{0x0020ba19, {
 		.manufacturer = "micron",
@@ -207,7 +272,12 @@ static std::map <uint32_t, flash_t> flash_list = {
 		.tb_offset = (1 << 5),
 		.tb_register = STATR,
 		.bp_len = 4,
-		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), (1 << 6)}}
+		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), (1 << 6)},
+		.block32_erase = false,
+		.erase_4k_ms = 0,
+		.erase_32k_ms = 0,
+		.erase_64k_ms = 0,
+		.erase_chip_ms = 0}
 	},
 	{0x0020bb19, {
 		.manufacturer = "micron",
@@ -220,7 +290,12 @@ static std::map <uint32_t, flash_t> flash_list = {
 		.tb_offset = (1 << 5),
 		.tb_register = STATR,
 		.bp_len = 4,
-		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), (1 << 6)}}
+		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), (1 << 6)},
+		.block32_erase = false,
+		.erase_4k_ms = 0,
+		.erase_32k_ms = 0,
+		.erase_64k_ms = 0,
+		.erase_chip_ms = 0}
 	},
 	{0x0020bb21, {
 		.manufacturer = "micron",
@@ -233,7 +308,12 @@ static std::map <uint32_t, flash_t> flash_list = {
 		.tb_offset = (1 << 5),
 		.tb_register = STATR,
 		.bp_len = 4,
-		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), (1 << 6)}}
+		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), (1 << 6)},
+		.block32_erase = true,
+		.erase_4k_ms = 0,
+		.erase_32k_ms = 0,
+		.erase_64k_ms = 0,
+		.erase_chip_ms = 0}
 	},
 	{0x0020bb22, {
 		.manufacturer = "micron",
@@ -246,7 +326,12 @@ static std::map <uint32_t, flash_t> flash_list = {
 		.tb_offset = (1 << 5),
 		.tb_register = STATR,
 		.bp_len = 4,
-		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), (1 << 6)}}
+		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), (1 << 6)},
+		.block32_erase = true,
+		.erase_4k_ms = 0,
+		.erase_32k_ms = 0,
+		.erase_64k_ms = 0,
+		.erase_chip_ms = 0}
 	},
 	{0xbf258d, {
 		.manufacturer = "microchip",
@@ -259,7 +344,12 @@ static std::map <uint32_t, flash_t> flash_list = {
 		.tb_offset = 0,
 		.tb_register = NONER,
 		.bp_len = 4,
-		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), (1 << 5)}}
+		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), (1 << 5)},
+		.block32_erase = true,
+		.erase_4k_ms = 0,
+		.erase_32k_ms = 0,
+		.erase_64k_ms = 0,
+		.erase_chip_ms = 0}
 	},
 	{0xBF2642, {
 		.manufacturer = "microchip",
@@ -272,7 +362,12 @@ static std::map <uint32_t, flash_t> flash_list = {
 		.tb_offset = 0,
 		.tb_register = NONER,
 		.bp_len = 0,
-		.bp_offset = {0, 0, 0, 0}}
+		.bp_offset = {0, 0, 0, 0},
+		.block32_erase = false,
+		.erase_4k_ms = 0,
+		.erase_32k_ms = 0,
+		.erase_64k_ms = 0,
+		.erase_chip_ms = 0}
 	},
 	{0xBF2643, {
 		.manufacturer = "microchip",
@@ -285,7 +380,12 @@ static std::map <uint32_t, flash_t> flash_list = {
 		.tb_offset = 0,
 		.tb_register = NONER,
 		.bp_len = 0,
-		.bp_offset = {0, 0, 0, 0}}
+		.bp_offset = {0, 0, 0, 0},
+		.block32_erase = false,
+		.erase_4k_ms = 0,
+		.erase_32k_ms = 0,
+		.erase_64k_ms = 0,
+		.erase_chip_ms = 0}
 	},
 	{0x9d6016, {
 		.manufacturer = "ISSI",
@@ -298,7 +398,12 @@ static std::map <uint32_t, flash_t> flash_list = {
 		.tb_offset = (1 << 1),
 		.tb_register = FUNCR,
 		.bp_len = 4,
-		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), (1 << 5)}}
+		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), (1 << 5)},
+		.block32_erase = true,
+		.erase_4k_ms = 0,
+		.erase_32k_ms = 0,
+		.erase_64k_ms = 0,
+		.erase_chip_ms = 0}
 	},
 	{0x9d6017, {
 		.manufacturer = "ISSI",
@@ -311,7 +416,12 @@ static std::map <uint32_t, flash_t> flash_list = {
 		.tb_offset = (1 << 1),
 		.tb_register = FUNCR,
 		.bp_len = 4,
-		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), (1 << 5)}}
+		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), (1 << 5)},
+		.block32_erase = true,
+		.erase_4k_ms = 0,
+		.erase_32k_ms = 0,
+		.erase_64k_ms = 0,
+		.erase_chip_ms = 0}
 	},
 	{0x9d6018, {
 		.manufacturer = "ISSI",
@@ -324,7 +434,12 @@ static std::map <uint32_t, flash_t> flash_list = {
 		.tb_offset = (1 << 1),
 		.tb_register = FUNCR,
 		.bp_len = 4,
-		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), (1 << 5)}}
+		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), (1 << 5)},
+		.block32_erase = true,
+		.erase_4k_ms = 0,
+		.erase_32k_ms = 0,
+		.erase_64k_ms = 0,
+		.erase_chip_ms = 0}
 	},
 	{0xc22016, {
 	/* https://www.macronix.com/Lists/Datasheet/Attachments/8933/MX25L3233F,%203V,%2032Mb,%20v1.7.pdf */
@@ -338,7 +453,12 @@ static std::map <uint32_t, flash_t> flash_list = {
 		.tb_offset = (1 << 3),
 		.tb_register = CONFR,
 		.bp_len = 5,
-		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), (1 << 5)}}
+		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), (1 << 5)},
+		.block32_erase = true,
+		.erase_4k_ms = 0,
+		.erase_32k_ms = 0,
+		.erase_64k_ms = 0,
+		.erase_chip_ms = 0}
 	},
 	{0xc22018, {
 	/* https://www.macronix.com/Lists/Datasheet/Attachments/8934/MX25L12833F,%203V,%20128Mb,%20v1.0.pdf */
@@ -352,7 +472,12 @@ static std::map <uint32_t, flash_t> flash_list = {
 		.tb_offset = (1 << 3),
 		.tb_register = CONFR,
 		.bp_len = 5,
-		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), (1 << 5)}}
+		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), (1 << 5)},
+		.block32_erase = true,
+		.erase_4k_ms = 0,
+		.erase_32k_ms = 0,
+		.erase_64k_ms = 0,
+		.erase_chip_ms = 0}
 	},
   {0xc2201a, {
       /* https://www.macronix.com/Lists/Datasheet/Attachments/8745/MX25L51245G,%203V,%20512Mb,%20v1.7.pdf */
@@ -366,7 +491,12 @@ static std::map <uint32_t, flash_t> flash_list = {
 		.tb_offset = (1 << 3),
 		.tb_register = CONFR,
 		.bp_len = 5,
-		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), (1 << 5)}}
+		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), (1 << 5)},
+		.block32_erase = true,
+		.erase_4k_ms = 0,
+		.erase_32k_ms = 0,
+		.erase_64k_ms = 0,
+		.erase_chip_ms = 0}
 	},
 	{0xc22817, {
 	/* https://www.macronix.com/Lists/Datasheet/Attachments/8868/MX25R6435F,%20Wide%20Range,%2064Mb,%20v1.6.pdf */
@@ -380,7 +510,12 @@ static std::map <uint32_t, flash_t> flash_list = {
 		.tb_offset = (1 << 3),
 		.tb_register = CONFR,
 		.bp_len = 4,
-		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), (1 << 5)}}
+		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), (1 << 5)},
+		.block32_erase = true,
+		.erase_4k_ms = 0,
+		.erase_32k_ms = 0,
+		.erase_64k_ms = 0,
+		.erase_chip_ms = 0}
 	},
 	{0xef4014, {
 	/* https://cdn-shop.adafruit.com/datasheets/W25Q80BV.pdf */
@@ -394,7 +529,12 @@ static std::map <uint32_t, flash_t> flash_list = {
 		.tb_offset = (1 << 5),
 		.tb_register = STATR,
 		.bp_len = 3,
-		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), 0}}
+		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), 0},
+		.block32_erase = true,
+		.erase_4k_ms = 45,
+		.erase_32k_ms = 120,
+		.erase_64k_ms = 150,
+		.erase_chip_ms = 0}
 	},
 	{0xef4015, {
 		.manufacturer = "Winbond",
@@ -407,7 +547,12 @@ static std::map <uint32_t, flash_t> flash_list = {
 		.tb_offset = (1 << 5),
 		.tb_register = STATR,
 		.bp_len = 3,
-		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), 0}}
+		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), 0},
+		.block32_erase = true,
+		.erase_4k_ms = 45,
+		.erase_32k_ms = 120,
+		.erase_64k_ms = 150,
+		.erase_chip_ms = 0}
 	},
 	{0xef4016, {
 		.manufacturer = "Winbond",
@@ -420,7 +565,12 @@ static std::map <uint32_t, flash_t> flash_list = {
 		.tb_offset = (1 << 5),
 		.tb_register = STATR,
 		.bp_len = 3,
-		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), 0}}
+		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), 0},
+		.block32_erase = true,
+		.erase_4k_ms = 45,
+		.erase_32k_ms = 120,
+		.erase_64k_ms = 150,
+		.erase_chip_ms = 0}
 	},
 	{0xef4017, {
 		.manufacturer = "Winbond",
@@ -433,7 +583,12 @@ static std::map <uint32_t, flash_t> flash_list = {
 		.tb_offset = (1 << 5),
 		.tb_register = STATR,
 		.bp_len = 3,
-		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), 0}}
+		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), 0},
+		.block32_erase = true,
+		.erase_4k_ms = 45,
+		.erase_32k_ms = 120,
+		.erase_64k_ms = 150,
+		.erase_chip_ms = 20000}
 	},
 	{0xef4018, {
 		.manufacturer = "Winbond",
@@ -446,7 +601,12 @@ static std::map <uint32_t, flash_t> flash_list = {
 		.tb_offset = (1 << 5),
 		.tb_register = STATR,
 		.bp_len = 3,
-		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), 0}}
+		.bp_offset = {(1 << 2), (1 << 3), (1 << 4), 0},
+		.block32_erase = true,
+		.erase_4k_ms = 45,
+		.erase_32k_ms = 120,
+		.erase_64k_ms = 150,
+		.erase_chip_ms = 40000}
 	},
         {0xba6015, {
                 .manufacturer = "Zetta",
@@ -459,7 +619,12 @@ static std::map <uint32_t, flash_t> flash_list = {
                 .tb_offset = (1 << 5),
                 .tb_register = STATR,
                 .bp_len = 3,
-                .bp_offset = {(1 << 2), (1 << 3), (1 << 4), 0}}
+                .bp_offset = {(1 << 2), (1 << 3), (1 << 4), 0},
+                .block32_erase = false,
+                .erase_4k_ms = 0,
+                .erase_32k_ms = 0,
+                .erase_64k_ms = 0,
+                .erase_chip_ms = 0}
         },
 
 };
@@ -7,21 +7,68 @@
 #include <vector>
 
 #include "display.hpp"
+#include "flashManifest.hpp"
 #include "spiInterface.hpp"
 #include "spiFlash.hpp"
 
 SPIInterface::SPIInterface():_spif_verbose(0), _spif_rd_burst(0),
-	_spif_verify(false), _skip_load_bridge(false)
+	_spif_verify(false), _skip_load_bridge(false), _skip_reset(false),
+	_spif_diff(false), _spif_session(0), _spif_prepared(false), _spif_flash(NULL)
 {}
 
 SPIInterface::SPIInterface(const std::string &filename, int8_t verbose,
 		uint32_t rd_burst, bool verify, bool skip_load_bridge,
-		bool skip_reset):
+		bool skip_reset, bool diff_prog):
 	_spif_verbose(verbose), _spif_rd_burst(rd_burst),
 	_spif_verify(verify), _skip_load_bridge(skip_load_bridge),
-	_skip_reset(skip_reset), _spif_filename(filename)
+	_skip_reset(skip_reset), _spif_diff(diff_prog), _spif_filename(filename),
+	_spif_session(0), _spif_prepared(false), _spif_flash(NULL)
 {}
 
+SPIInterface::~SPIInterface()
+{
+	delete _spif_flash;
+}
+
+bool SPIInterface::end_flash_session()
+{
+	if (_spif_session == 0 || --_spif_session != 0)
+		return true;
+	return close_flash_access(true);
+}
+
+bool SPIInterface::open_flash_access()
+{
+	if (_spif_prepared)
+		return true;
+	if (!prepare_flash_access())
+		return false;
+	_spif_prepared = true;
+	return true;
+}
+
+SPIFlash *SPIInterface::get_flash(bool unprotect)
+{
+	if (!_spif_flash) {
+		_spif_flash = new SPIFlash(this, unprotect, _spif_verbose);
+		_spif_flash->set_diff_prog(_spif_diff);
+	} else {
+		_spif_flash->set_unprotect(unprotect);
+	}
+	return _spif_flash;
+}
+
+bool SPIInterface::close_flash_access(bool ret)
+{
+	if (_spif_session != 0 || !_spif_prepared)
+		return ret;
+	/* flash state is unknown after reload */
+	delete _spif_flash;
+	_spif_flash = NULL;
+	_spif_prepared = false;
+	return post_flash_access() && ret;
+}
+
 /* spiFlash generic acces */
 bool SPIInterface::protect_flash(uint32_t len)
 {
@@ -29,17 +76,17 @@ bool SPIInterface::protect_flash(uint32_t len)
 	printInfo("protect_flash: ", false);
 
 	/* move device to spi access */
-	if (!prepare_flash_access()) {
+	if (!open_flash_access()) {
 		printError("Fail");
 		return false;
 	}
 
 	/* spi flash access */
 	try {
-		SPIFlash flash(this, false, _spif_verbose);
+		SPIFlash *flash = get_flash(false);
 
 		/* configure flash protection */
-		ret = (flash.enable_protection(len) == 0);
+		ret = (flash->enable_protection(len) == 0);
 		if (!ret)
 			printError("Fail");
 		else
@@ -50,8 +97,8 @@ bool SPIInterface::protect_flash(uint32_t len)
 		ret = false;
 	}
 
-	/* reload bitstream */
-	return post_flash_access() && ret;
+	/* reload bitstream (at the end of the session) */
+	return close_flash_access(ret);
 }
 
 bool SPIInterface::unprotect_flash()
@@ -59,18 +106,18 @@ bool SPIInterface::unprotect_flash()
 	bool ret = true;
 
 	/* move device to spi access */
-	if (!prepare_flash_access()) {
+	if (!open_flash_access()) {
 		printError("SPI Flash prepare access failed");
 		return false;
 	}
 
 	/* spi flash access */
 	try {
-		SPIFlash flash(this, false, _spif_verbose);
+		SPIFlash *flash = get_flash(false);
 
 		/* configure flash protection */
 		printInfo("unprotect_flash: ", false);
-		ret = (flash.disable_protection() == 0);
+		ret = (flash->disable_protection() == 0);
 		if (!ret)
 			printError("Fail");
 		else
@@ -81,8 +128,8 @@ bool SPIInterface::unprotect_flash()
 		ret = false;
 	}
 
-	/* reload bitstream */
-	return post_flash_access() && ret;
+	/* reload bitstream (at the end of the session) */
+	return close_flash_access(ret);
 }
 
 bool SPIInterface::bulk_erase_flash()
@@ -91,17 +138,17 @@ bool SPIInterface::bulk_erase_flash()
 	printInfo("bulk_erase: ", false);
 
 	/* move device to spi access */
-	if (!prepare_flash_access()) {
+	if (!open_flash_access()) {
 		printError("Fail");
 		return false;
 	}
 
 	/* spi flash access */
 	try {
-		SPIFlash flash(this, false, _spif_verbose);
+		SPIFlash *flash = get_flash(false);
 
 		/* bulk erase flash */
-		ret = (flash.bulk_erase() == 0);
+		ret = (flash->bulk_erase() == 0);
 		if (!ret)
 			printError("Fail");
 		else
@@ -112,68 +159,92 @@ bool SPIInterface::bulk_erase_flash()
 		ret = false;
 	}
 
-	/* reload bitstream */
-	return post_flash_access() && ret;
+	/* reload bitstream (at the end of the session) */
+	return close_flash_access(ret);
 }
 
 bool SPIInterface::write(uint32_t offset, const uint8_t *data, uint32_t len,
 		bool unprotect_flash)
 {
 	bool ret = true;
-	if (!prepare_flash_access())
+	if (!open_flash_access())
 		return false;
 
 	/* test SPI */
 	try {
-		SPIFlash flash(this, unprotect_flash, _spif_verbose);
-		flash.read_status_reg();
-		if (flash.erase_and_prog(offset, data, len) == -1)
+		SPIFlash *flash = get_flash(unprotect_flash);
+		flash->read_status_reg();
+		if (flash->erase_and_prog(offset, data, len) == -1)
 			ret = false;
 		if (_spif_verify && ret)
-			ret = flash.verify(offset, data, len, _spif_rd_burst);
+			ret = flash->verify(offset, data, len, _spif_rd_burst);
+		if (!_spif_manifest.empty() && ret)
+			ret = FlashManifest::create(_spif_manifest, offset, data, len);
 	} catch (std::exception &e) {
 		printError(e.what());
 		ret = false;
 	}
 
-	bool ret2 = post_flash_access();
-	return ret && ret2;
+	return close_flash_access(ret);
 }
 
 bool SPIInterface::read(uint8_t *data, uint32_t base_addr, uint32_t len)
 {
 	bool ret = true;
 	/* enable SPI flash access */
-	if (!prepare_flash_access())
+	if (!open_flash_access())
 		return false;
 
 	try {
-		SPIFlash flash(this, false, _spif_verbose);
-		ret = flash.read(base_addr, data, len);
+		SPIFlash *flash = get_flash(false);
+		ret = (flash->read(base_addr, data, len) == 0);
 	} catch (std::exception &e) {
 		printError(e.what());
 		ret = false;
 	}
 
-	/* reload bitstream */
-	return post_flash_access() && ret == 0;
+	/* reload bitstream (at the end of the session) */
+	return close_flash_access(ret);
 }
 
 bool SPIInterface::dump(uint32_t base_addr, uint32_t len)
 {
 	bool ret = true;
 	/* enable SPI flash access */
-	if (!prepare_flash_access())
+	if (!open_flash_access())
 		return false;
 
 	try {
-		SPIFlash flash(this, false, _spif_verbose);
-		ret = flash.dump(_spif_filename, base_addr, len, _spif_rd_burst);
+		SPIFlash *flash = get_flash(false);
+		ret = flash->dump(_spif_filename, base_addr, len, _spif_rd_burst);
 	} catch (std::exception &e) {
 		printError(e.what());
 		ret = false;
 	}
 
-	/* reload bitstream */
-	return post_flash_access() && ret;
+	/* reload bitstream (at the end of the session) */
+	return close_flash_access(ret);
+}
+
+bool SPIInterface::verify_manifest()
+{
+	FlashManifest manifest;
+	if (!manifest.load(_spif_manifest))
+		return false;
+
+	bool ret = true;
+	/* enable SPI flash access */
+	if (!open_flash_access())
+		return false;
+
+	try {
+		SPIFlash *flash = get_flash(false);
+		ret = flash->verify(manifest, _spif_rd_burst);
+	} catch (std::exception &e) {
+		printError(e.what());
+		ret = false;
+	}
+
+	/* reload bitstream (at the end of the session) */
+	return close_flash_access(ret);
 }
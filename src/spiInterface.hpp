@@ -11,6 +11,8 @@
 #include <string>
 #include <vector>
 
+class SPIFlash;
+
 /*!
  * \file SPIInterface.hpp
  * \class SPIInterface
@@ -23,13 +25,33 @@ class SPIInterface {
 	SPIInterface();
 	SPIInterface(const std::string &filename, int8_t verbose,
 			uint32_t rd_burst, bool verify, bool skip_load_bridge = false,
-			bool skip_reset = false);
-	virtual ~SPIInterface() {}
+			bool skip_reset = false, bool diff_prog = false);
+	virtual ~SPIInterface();
+
+	/*!
+	 * \brief start a flash session: operations done until
+	 *        end_flash_session share one prepare_flash_access /
+	 *        post_flash_access and one flash probe. Access is entered
+	 *        by the first operation (nothing is done for an empty
+	 *        session). Sessions may be nested
+	 */
+	void begin_flash_session() {_spif_session++;}
+	/*!
+	 * \brief end a flash session: the outermost end reloads the
+	 *        device when flash was accessed
+	 * \return false when reload fails
+	 */
+	bool end_flash_session();
 
 	bool protect_flash(uint32_t len);
 	bool unprotect_flash();
 	bool bulk_erase_flash();
 	void set_filename(const std::string &filename) {_spif_filename = filename;}
+	/*!
+	 * \brief set manifest file: created by write, used by
+	 *        verify_manifest
+	 */
+	void set_manifest(const std::string &filename) {_spif_manifest = filename;}
 
 	/*!
 	 * \brief write len byte into flash starting at offset,
@@ -69,6 +91,12 @@ class SPIInterface {
 	 */
 	bool dump(uint32_t base_addr, uint32_t len);
 
+	/*!
+	 * \brief check flash content against manifest (see set_manifest)
+	 * \return false when read fails or content differs
+	 */
+	bool verify_manifest();
+
 	/*!
 	 * \brief send a command, followed by len byte.
 	 * \param[in] cmd: command/opcode to send
@@ -110,14 +138,36 @@ class SPIInterface {
 	 * \brief end of SPI flash access
 	 */
 	virtual bool post_flash_access() {return false;}
+	/*!
+	 * \brief call prepare_flash_access if not already done
+	 *        in current session
+	 */
+	bool open_flash_access();
+	/*!
+	 * \brief return flash instance (probed once per access)
+	 * \param[in] unprotect: allows to unprotect blocks
+	 */
+	SPIFlash *get_flash(bool unprotect);
+	/*!
+	 * \brief end of an operation: call post_flash_access unless
+	 *        a session is in progress
+	 * \param[in] ret: operation status
+	 * \return ret and post_flash_access status
+	 */
+	bool close_flash_access(bool ret);
 
 	int8_t _spif_verbose;
 	uint32_t _spif_rd_burst;
 	bool _spif_verify;
 	bool _skip_load_bridge;
 	bool _skip_reset; /*!< don't reset the device after write */
+	bool _spif_diff; /*!< only write flash sectors with changes */
 
  private:
 	std::string _spif_filename;
+	std::string _spif_manifest; /*!< manifest file ("": none) */
+	int _spif_session;     /*!< flash session nesting level */
+	bool _spif_prepared;   /*!< prepare_flash_access done */
+	SPIFlash *_spif_flash; /*!< flash probed in current access */
 };
 #endif  // SRC_SPIINTERFACE_HPP_